@@ -0,0 +1,65 @@
+/*
+ *      Copyright (C) 2018 Aassif Benassarou
+ *      http://github.com/aassif/pvr.freebox/
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include <algorithm>
+#include <tuple>
+#include "Bouquet.h"
+
+using namespace std;
+
+Bouquet::Bouquet (size_t capacity) :
+  m_entries ()
+{
+  m_entries.reserve (capacity);
+}
+
+void Bouquet::Add (string_view uuid, int major, int minor, int position)
+{
+  m_entries.push_back (Entry {uuid, major, minor, position});
+}
+
+vector<Bouquet::Entry> Bouquet::Resolve () const
+{
+  vector<Entry> v (m_entries);
+
+  // By number: lowest sub-number first (then bouquet order).
+  sort (v.begin (), v.end (), [] (const Entry & a, const Entry & b)
+  {
+    return tie (a.major, a.minor, a.position) < tie (b.major, b.minor, b.position);
+  });
+  v.erase (unique (v.begin (), v.end (),
+                   [] (const Entry & a, const Entry & b) {return a.major == b.major;}),
+           v.end ());
+
+  // By channel: lowest number first.
+  sort (v.begin (), v.end (), [] (const Entry & a, const Entry & b)
+  {
+    return tie (a.uuid, a.major, a.minor) < tie (b.uuid, b.major, b.minor);
+  });
+  v.erase (unique (v.begin (), v.end (),
+                   [] (const Entry & a, const Entry & b) {return a.uuid == b.uuid;}),
+           v.end ());
+
+  // Numbers are unique by now.
+  sort (v.begin (), v.end (), [] (const Entry & a, const Entry & b) {return a.major < b.major;});
+  return v;
+}
+
@@ -0,0 +1,51 @@
+#pragma once
+/*
+ *      Copyright (C) 2018 Aassif Benassarou
+ *      http://github.com/aassif/pvr.freebox/
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include <string_view>
+#include <vector>
+
+// Channel numbering conflicts (Freebox bouquet): each number goes to its
+// lowest sub-number, then each channel keeps its lowest number.
+// Flat, sort-based: O(n log n), no per-entry allocation.
+class Bouquet
+{
+  public:
+    class Entry
+    {
+      public:
+        std::string_view uuid;  // not owned
+        int major, minor;       // numéro de chaîne
+        int position;           // position dans le bouquet
+    };
+
+  private:
+    std::vector<Entry> m_entries;
+
+  public:
+    Bouquet (size_t capacity = 0);
+
+    void Add (std::string_view uuid, int major, int minor, int position);
+
+    // Winners, by number.
+    std::vector<Entry> Resolve () const;
+};
+
@@ -0,0 +1,1070 @@
+/*
+ *      Copyright (C) 2018 Aassif Benassarou
+ *      http://github.com/aassif/pvr.freebox/
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include <fstream>
+#include <algorithm>
+#include <limits>
+#include <cstdio>
+#include <cstring>
+#include "EPG.h"
+
+#ifdef TARGET_WINDOWS
+  #include <windows.h>
+#else
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+#endif
+
+using namespace std;
+
+#define PVR_FREEBOX_EPG_MAGIC   0x45584246 // "FBXE"
+#define PVR_FREEBOX_EPG_VERSION 3
+#define PVR_FREEBOX_EPG_WINDOW  12 // deflate window (bits)
+
+namespace
+{
+  struct Header
+  {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t records;
+    uint32_t slices;
+    uint64_t heap;
+    uint64_t texts;
+  };
+
+  // Text, as stored (followed by 'packed' bytes, or 'size' if not deflated).
+  struct TextHeader
+  {
+    uint32_t size;
+    uint32_t packed; // 0 = stored as is
+  };
+
+  // Preset dictionary: frequent words and phrases of programme descriptions
+  // (most frequent last, closer to the text).
+  const char EPG_DICTIONARY [] =
+    "Présenté par En direct Inédit Rediffusion documentaire reportage magazine "
+    "enquête portrait histoire aventure policier comédie dramatique animation "
+    "épisode saison série téléfilm émission invités chroniqueurs plateau "
+    "l'actualité politique économique culturelle sportive match championnat "
+    "Au programme : Ce soir, Dans cet épisode, Alors que Tandis que Pendant ce temps, "
+    "découvrir découvre rencontre retrouve décide tente doit mais aussi "
+    "jeune femme jeune homme son père sa mère sa famille ses amis leur vie "
+    "une enquête sur la mort d'un mystérieux meurtre police inspecteur commissaire "
+    "les plus beaux les plus grands à travers le monde de la France du pays "
+    "qui est avec pour dans sur par une des les est pas plus que se son sa ses "
+    "de la et le à la en du des les un une l' d' qu' ";
+
+  struct Slice
+  {
+    int64_t time;
+    int64_t fetched;
+  };
+
+  const time_t EPG_NEVER = numeric_limits<time_t>::max ();
+
+  inline
+  bool epg_less (const EPGStore::Record & r, uint32_t channel, int64_t start)
+  {
+    return r.channel != channel ? r.channel < channel : r.start < start;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// E P G F I L E ///////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+EPGFile::EPGFile () :
+  m_data (nullptr),
+  m_size (0)
+#ifdef TARGET_WINDOWS
+ ,m_file (INVALID_HANDLE_VALUE),
+  m_mapping (NULL)
+#endif
+{
+}
+
+EPGFile::~EPGFile ()
+{
+  Close ();
+}
+
+bool EPGFile::Open (const string & path)
+{
+  Close ();
+
+#ifdef TARGET_WINDOWS
+  m_file = CreateFileA (path.c_str (), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (m_file == INVALID_HANDLE_VALUE) return false;
+
+  LARGE_INTEGER size;
+  if (! GetFileSizeEx (m_file, &size) || size.QuadPart == 0) {Close (); return false;}
+
+  m_mapping = CreateFileMappingA (m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (m_mapping == NULL) {Close (); return false;}
+
+  m_data = (const char *) MapViewOfFile (m_mapping, FILE_MAP_READ, 0, 0, 0);
+  if (m_data == NULL) {Close (); return false;}
+
+  m_size = (size_t) size.QuadPart;
+#else
+  int fd = open (path.c_str (), O_RDONLY);
+  if (fd < 0) return false;
+
+  struct stat st;
+  if (fstat (fd, &st) != 0 || st.st_size == 0) {close (fd); return false;}
+
+  void * data = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+  if (data == MAP_FAILED) return false;
+
+  m_data = (const char *) data;
+  m_size = st.st_size;
+#endif
+
+  return true;
+}
+
+void EPGFile::Close ()
+{
+#ifdef TARGET_WINDOWS
+  if (m_data)                         UnmapViewOfFile (m_data);
+  if (m_mapping)                      CloseHandle (m_mapping);
+  if (m_file != INVALID_HANDLE_VALUE) CloseHandle (m_file);
+  m_mapping = NULL;
+  m_file    = INVALID_HANDLE_VALUE;
+#else
+  if (m_data) munmap ((void *) m_data, m_size);
+#endif
+  m_data = nullptr;
+  m_size = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// E P G S E T /////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+  // Fibonacci hashing (capacity is a power of 2).
+  inline
+  size_t epg_hash (uint32_t id, size_t mask)
+  {
+    return (size_t) ((id * UINT64_C (0x9E3779B97F4A7C15)) >> 32) & mask;
+  }
+}
+
+EPGSet::EPGSet (size_t capacity) :
+  m_slots (),
+  m_size (0),
+  m_zero (false)
+{
+  size_t n = 16;
+  while (n < capacity) n <<= 1;
+  m_slots.assign (n, 0);
+}
+
+void EPGSet::Grow ()
+{
+  vector<uint32_t> slots (m_slots.size () * 2, 0);
+  size_t mask = slots.size () - 1;
+
+  for (uint32_t id : m_slots)
+    if (id != 0)
+    {
+      size_t i = epg_hash (id, mask);
+      while (slots [i] != 0) i = (i + 1) & mask;
+      slots [i] = id;
+    }
+
+  m_slots.swap (slots);
+}
+
+bool EPGSet::Insert (uint32_t id)
+{
+  if (id == 0)
+  {
+    bool inserted = ! m_zero;
+    m_zero = true;
+    return inserted;
+  }
+
+  // Load factor <= 1/2.
+  if (2 * (m_size + 1) > m_slots.size ()) Grow ();
+
+  size_t mask = m_slots.size () - 1;
+  for (size_t i = epg_hash (id, mask);; i = (i + 1) & mask)
+  {
+    if (m_slots [i] == id) return false;
+    if (m_slots [i] == 0)
+    {
+      m_slots [i] = id;
+      ++m_size;
+      return true;
+    }
+  }
+}
+
+bool EPGSet::Contains (uint32_t id) const
+{
+  if (id == 0) return m_zero;
+
+  size_t mask = m_slots.size () - 1;
+  for (size_t i = epg_hash (id, mask);; i = (i + 1) & mask)
+  {
+    if (m_slots [i] == id) return true;
+    if (m_slots [i] == 0)  return false;
+  }
+}
+
+void EPGSet::Clear ()
+{
+  fill (m_slots.begin (), m_slots.end (), 0);
+  m_size = 0;
+  m_zero = false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// E P G S T O R E /////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+EPGStore::Entry::Entry () :
+  broadcast   (0),
+  channel     (0),
+  start       (0),
+  duration    (0),
+  category    (0),
+  season      (0),
+  episode     (0),
+  year        (0),
+  extended    (false),
+  fingerprint (0),
+  title       (),
+  subtitle    (),
+  outline     (),
+  plot        (),
+  picture     (),
+  actors      (),
+  director    ()
+{
+}
+
+EPGStore::Entry::Entry (const View & v) :
+  broadcast   (v.broadcast),
+  channel     (v.channel),
+  start       (v.start),
+  duration    (v.duration),
+  category    (v.category),
+  season      (v.season),
+  episode     (v.episode),
+  year        (v.year),
+  extended    (v.extended),
+  fingerprint (v.fingerprint),
+  title       (v.title),
+  subtitle    (v.subtitle),
+  outline     (v.outline),
+  plot        (v.plot),
+  picture     (v.picture),
+  actors      (v.actors),
+  director    (v.director)
+{
+}
+
+EPGStore::View::View () :
+  broadcast   (0),
+  channel     (0),
+  start       (0),
+  duration    (0),
+  category    (0),
+  season      (0),
+  episode     (0),
+  year        (0),
+  extended    (false),
+  fingerprint (0),
+  title       (),
+  subtitle    (),
+  outline     (),
+  plot        (),
+  picture     (),
+  actors      (),
+  director    ()
+{
+}
+
+EPGStore::View::View (const Entry & e) :
+  broadcast   (e.broadcast),
+  channel     (e.channel),
+  start       (e.start),
+  duration    (e.duration),
+  category    (e.category),
+  season      (e.season),
+  episode     (e.episode),
+  year        (e.year),
+  extended    (e.extended),
+  fingerprint (e.fingerprint),
+  title       (e.title),
+  subtitle    (e.subtitle),
+  outline     (e.outline),
+  plot        (e.plot),
+  picture     (e.picture),
+  actors      (e.actors),
+  director    (e.director)
+{
+}
+
+/* static */
+uint32_t EPGStore::Hash (string_view title, string_view subtitle, int64_t start, int duration)
+{
+  // FNV-1a.
+  uint32_t h = 2166136261u;
+  auto hash = [&h] (const char * data, size_t size)
+  {
+    for (size_t i = 0; i < size; ++i)
+      h = (h ^ (uint8_t) data [i]) * 16777619u;
+  };
+
+  hash (title.data (),    title.size ());
+  hash ("",               1);
+  hash (subtitle.data (), subtitle.size ());
+  hash ((const char *) &start,    sizeof (start));
+  hash ((const char *) &duration, sizeof (duration));
+  return h != 0 ? h : 1;
+}
+
+EPGStore::EPGStore (const string & path) :
+  m_mutex (),
+  m_path (path),
+  m_file (),
+  m_records (nullptr),
+  m_count (0),
+  m_heap (nullptr),
+  m_heap_size (0),
+  m_texts (nullptr),
+  m_texts_size (0),
+  m_added (),
+  m_added_heap (),
+  m_added_texts (),
+  m_strings (),
+  m_texts_index (),
+  m_index (),
+  m_slices (),
+  m_dirty (false),
+  m_peak (0)
+{
+  memset (&m_deflate, 0, sizeof (z_stream));
+  memset (&m_inflate, 0, sizeof (z_stream));
+  deflateInit2 (&m_deflate, Z_BEST_COMPRESSION, Z_DEFLATED, -PVR_FREEBOX_EPG_WINDOW, 8, Z_DEFAULT_STRATEGY);
+  inflateInit2 (&m_inflate, -PVR_FREEBOX_EPG_WINDOW);
+}
+
+EPGStore::~EPGStore ()
+{
+  deflateEnd (&m_deflate);
+  inflateEnd (&m_inflate);
+}
+
+bool EPGStore::Map ()
+{
+  m_records   = nullptr;
+  m_count     = 0;
+  m_heap      = nullptr;
+  m_heap_size = 0;
+  m_texts      = nullptr;
+  m_texts_size = 0;
+  m_strings.clear ();
+  m_texts_index.clear ();
+  m_index.clear ();
+  m_timelines.clear ();
+  m_slices.clear ();
+
+  if (! m_file.Open (m_path))
+    return false;
+
+  const char * data = m_file.Data ();
+  size_t       size = m_file.Size ();
+
+  Header h;
+  if (size < sizeof (Header)) {m_file.Close (); return false;}
+  memcpy (&h, data, sizeof (Header));
+
+  size_t slices  = sizeof (Header);
+  size_t records = slices  + (size_t) h.slices  * sizeof (Slice);
+  size_t heap    = records + (size_t) h.records * sizeof (Record);
+  size_t texts   = heap    + (size_t) h.heap;
+
+  if (h.magic != PVR_FREEBOX_EPG_MAGIC || h.version != PVR_FREEBOX_EPG_VERSION || texts + h.texts != size)
+  {
+    m_file.Close ();
+    return false;
+  }
+
+  for (uint32_t i = 0; i < h.slices; ++i)
+  {
+    Slice s;
+    memcpy (&s, data + slices + i * sizeof (Slice), sizeof (Slice));
+    m_slices [s.time] = s.fetched;
+  }
+
+  // Records are 8-byte aligned (header and slices are).
+  m_records   = (const Record *) (data + records);
+  m_count     = h.records;
+  m_heap      = data + heap;
+  m_heap_size = h.heap;
+
+  // Last string not terminated: String () would read past the heap.
+  if (m_heap_size > 0 && m_heap [m_heap_size - 1] != '\0')
+  {
+    m_records   = nullptr;
+    m_count     = 0;
+    m_heap      = nullptr;
+    m_heap_size = 0;
+    m_slices.clear ();
+    m_file.Close ();
+    return false;
+  }
+
+  // Strings are stored back to back (NUL-terminated).
+  for (size_t o = 0; o < m_heap_size;)
+  {
+    size_t n = strnlen (m_heap + o, m_heap_size - o);
+    m_strings.emplace (hash<string_view> () (string_view (m_heap + o, n)), o + 1);
+    o += n + 1;
+  }
+
+  m_texts      = data + texts;
+  m_texts_size = h.texts;
+
+  for (size_t o = 0; o < m_texts_size;)
+  {
+    string_view t = Text (o + 1);
+    if (t.empty ()) break; // truncated
+    m_texts_index.emplace (hash<string_view> () (t), o + 1);
+    o += t.size ();
+  }
+
+  for (size_t i = 0; i < m_count; ++i)
+  {
+    m_index [m_records [i].broadcast] = i;
+    Index (i);
+  }
+
+  return true;
+}
+
+void EPGStore::Index (size_t i)
+{
+  const Record & r = At (i);
+  Timeline & t = m_timelines [r.channel];
+
+  Interval interval {r.start, r.start + r.duration, i};
+  auto p = upper_bound (t.intervals.begin (), t.intervals.end (), interval,
+                        [] (const Interval & a, const Interval & b) {return a.start < b.start;});
+  t.intervals.insert (p, interval);
+
+  if (t.intervals.size () == 1 || r.duration > t.longest)
+    t.longest = r.duration;
+}
+
+void EPGStore::Unindex (size_t i)
+{
+  const Record & r = At (i);
+  auto f = m_timelines.find (r.channel);
+  if (f == m_timelines.end ()) return;
+
+  vector<Interval> & v = f->second.intervals;
+  auto p = lower_bound (v.begin (), v.end (), r.start,
+                        [] (const Interval & a, int64_t s) {return a.start < s;});
+  for (; p != v.end () && p->start == r.start; ++p)
+    if (p->record == i)
+    {
+      v.erase (p);
+      return;
+    }
+}
+
+const EPGStore::Record & EPGStore::At (size_t i) const
+{
+  return i < m_count ? m_records [i] : m_added [i - m_count];
+}
+
+const char * EPGStore::String (uint32_t offset) const
+{
+  if (offset == 0) return "";
+
+  size_t o = offset - 1;
+  if (o < m_heap_size) return m_heap + o;
+
+  o -= m_heap_size;
+  return o < m_added_heap.size () ? m_added_heap.data () + o : "";
+}
+
+uint32_t EPGStore::Append (string_view s)
+{
+  if (s.empty ()) return 0;
+
+  size_t h = hash<string_view> () (s);
+  auto range = m_strings.equal_range (h);
+  for (auto i = range.first; i != range.second; ++i)
+    if (s == String (i->second))
+      return i->second;
+
+  uint32_t offset = m_heap_size + m_added_heap.size () + 1;
+  m_added_heap.append (s.data (), s.size ()).push_back ('\0');
+  m_strings.emplace (h, offset);
+  return offset;
+}
+
+string_view EPGStore::Text (uint32_t offset) const
+{
+  if (offset == 0) return string_view ();
+
+  const char * data;
+  size_t       size;
+
+  size_t o = offset - 1;
+  if (o < m_texts_size)
+  {
+    data = m_texts + o;
+    size = m_texts_size - o;
+  }
+  else
+  {
+    o -= m_texts_size;
+    if (o >= m_added_texts.size ()) return string_view ();
+    data = m_added_texts.data () + o;
+    size = m_added_texts.size () - o;
+  }
+
+  TextHeader t;
+  if (size < sizeof (TextHeader)) return string_view ();
+  memcpy (&t, data, sizeof (TextHeader));
+
+  size_t n = sizeof (TextHeader) + (t.packed != 0 ? t.packed : t.size);
+  return n <= size ? string_view (data, n) : string_view ();
+}
+
+uint32_t EPGStore::Pack (string_view s)
+{
+  if (s.empty ()) return 0;
+
+  // Deflated (unless it does not help), right after its header.
+  TextHeader t {(uint32_t) s.size (), 0};
+  deflateReset (&m_deflate);
+  deflateSetDictionary (&m_deflate, (const Bytef *) EPG_DICTIONARY, sizeof (EPG_DICTIONARY) - 1);
+  m_scratch.resize (sizeof (TextHeader) + deflateBound (&m_deflate, s.size ()));
+  m_deflate.next_in   = (Bytef *) s.data ();
+  m_deflate.avail_in  = s.size ();
+  m_deflate.next_out  = (Bytef *) &m_scratch [sizeof (TextHeader)];
+  m_deflate.avail_out = m_scratch.size () - sizeof (TextHeader);
+  if (deflate (&m_deflate, Z_FINISH) == Z_STREAM_END && m_deflate.total_out < s.size ())
+  {
+    t.packed = m_deflate.total_out;
+    m_scratch.resize (sizeof (TextHeader) + t.packed);
+  }
+  else
+  {
+    m_scratch.resize (sizeof (TextHeader));
+    m_scratch.append (s.data (), s.size ());
+  }
+  memcpy (&m_scratch [0], &t, sizeof (TextHeader));
+
+  // Interned.
+  size_t h = hash<string_view> () (m_scratch);
+  auto range = m_texts_index.equal_range (h);
+  for (auto i = range.first; i != range.second; ++i)
+    if (Text (i->second) == m_scratch)
+      return i->second;
+
+  uint32_t offset = m_texts_size + m_added_texts.size () + 1;
+  m_added_texts.append (m_scratch);
+  m_texts_index.emplace (h, offset);
+  return offset;
+}
+
+string EPGStore::Unpack (uint32_t offset) const
+{
+  string_view b = Text (offset);
+  if (b.empty ()) return string ();
+
+  TextHeader t;
+  memcpy (&t, b.data (), sizeof (TextHeader));
+  const char * data = b.data () + sizeof (TextHeader);
+  if (t.packed == 0) return string (data, t.size);
+
+  string s (t.size, '\0');
+  inflateReset (&m_inflate);
+  inflateSetDictionary (&m_inflate, (const Bytef *) EPG_DICTIONARY, sizeof (EPG_DICTIONARY) - 1);
+  m_inflate.next_in   = (Bytef *) data;
+  m_inflate.avail_in  = t.packed;
+  m_inflate.next_out  = (Bytef *) &s [0];
+  m_inflate.avail_out = t.size;
+  if (inflate (&m_inflate, Z_FINISH) != Z_STREAM_END || m_inflate.avail_out != 0)
+    return string ();
+
+  return s;
+}
+
+EPGStore::Entry EPGStore::Get (const Record & r) const
+{
+  Entry e;
+  e.broadcast   = r.broadcast;
+  e.channel     = r.channel;
+  e.start       = r.start;
+  e.duration    = r.duration;
+  e.category    = r.category;
+  e.season      = r.season;
+  e.episode     = r.episode;
+  e.year        = r.year;
+  e.extended    = (r.flags & Record::EXTENDED) != 0;
+  e.fingerprint = r.fingerprint;
+  e.title       = String (r.title);
+  e.subtitle    = String (r.subtitle);
+  e.outline     = Unpack (r.outline);
+  e.plot        = Unpack (r.plot);
+  e.picture     = String (r.picture);
+  e.actors      = String (r.actors);
+  e.director    = String (r.director);
+  return e;
+}
+
+bool EPGStore::Load ()
+{
+  P8PLATFORM::CLockObject lock (m_mutex);
+  m_added.clear ();
+  m_added_heap.clear ();
+  m_added_texts.clear ();
+  m_dirty = false;
+  return Map ();
+}
+
+bool EPGStore::Save (time_t now)
+{
+  P8PLATFORM::CLockObject lock (m_mutex);
+  if (! m_dirty) return true;
+
+  return Write (now, EPG_NEVER, EPG_NEVER);
+}
+
+bool EPGStore::Write (time_t now, time_t strip, time_t drop)
+{
+  // Live records, with a fresh heap.
+  vector<Record> records;
+  string heap;
+  // Interned (views into the current heap, untouched until Map ()).
+  unordered_map<string_view, uint32_t> offsets;
+  auto append = [this, &heap, &offsets] (uint32_t offset) -> uint32_t
+  {
+    if (offset == 0) return 0;
+    string_view s = String (offset);
+    auto f = offsets.find (s);
+    if (f != offsets.end ()) return f->second;
+    uint32_t r = heap.size () + 1;
+    heap.append (s.data (), s.size ()).push_back ('\0');
+    offsets.emplace (s, r);
+    return r;
+  };
+
+  // Texts are copied as stored (deflated), interned too.
+  string texts;
+  unordered_map<string_view, uint32_t> texts_offsets;
+  auto append_text = [this, &texts, &texts_offsets] (uint32_t offset) -> uint32_t
+  {
+    string_view t = Text (offset);
+    if (t.empty ()) return 0;
+    auto f = texts_offsets.find (t);
+    if (f != texts_offsets.end ()) return f->second;
+    uint32_t r = texts.size () + 1;
+    texts.append (t.data (), t.size ());
+    texts_offsets.emplace (t, r);
+    return r;
+  };
+
+  for (size_t i = 0, n = m_count + m_added.size (); i < n; ++i)
+  {
+    const Record & r = At (i);
+    auto f = m_index.find (r.broadcast);
+    if (f == m_index.end () || f->second != i) continue; // superseded, removed
+    if (r.start + r.duration < now)            continue; // expired
+    if (r.start >= drop)                       continue; // evicted
+
+    // Far events lose their texts (and extended details with them).
+    bool stripped = r.start >= strip;
+
+    Record c = r;
+    c.flags    = stripped ? r.flags & ~Record::EXTENDED : r.flags;
+    c.title    = append (r.title);
+    c.subtitle = append (r.subtitle);
+    c.outline  = stripped ? 0 : append_text (r.outline);
+    c.plot     = stripped ? 0 : append_text (r.plot);
+    c.picture  = append (r.picture);
+    c.actors   = append (r.actors);
+    c.director = append (r.director);
+    records.push_back (c);
+  }
+
+  sort (records.begin (), records.end (),
+        [] (const Record & a, const Record & b) {return epg_less (a, b.channel, b.start);});
+
+  vector<Slice> slices;
+  for (auto & s : m_slices)
+    if (s.first + 3600 > now && s.first < drop)
+      slices.push_back (Slice {s.first, s.second});
+
+  Header h {PVR_FREEBOX_EPG_MAGIC, PVR_FREEBOX_EPG_VERSION,
+            (uint32_t) records.size (), (uint32_t) slices.size (), heap.size (), texts.size ()};
+
+  string tmp = m_path + ".tmp";
+  {
+    ofstream ofs (tmp, ios::binary | ios::trunc);
+    ofs.write ((const char *) &h, sizeof (Header));
+    ofs.write ((const char *) slices.data (),  slices.size ()  * sizeof (Slice));
+    ofs.write ((const char *) records.data (), records.size () * sizeof (Record));
+    ofs.write (heap.data (), heap.size ());
+    ofs.write (texts.data (), texts.size ());
+    if (! ofs) return false;
+  }
+
+  // Replaced atomically: on failure, the old file (and mapping) is kept.
+#ifdef TARGET_WINDOWS
+  // A mapped file can't be replaced: unmapped first, mapped again on
+  // failure (same file, so the indexes still hold).
+  auto index       = move (m_index);
+  auto timelines   = move (m_timelines);
+  auto strings     = move (m_strings);
+  auto texts_index = move (m_texts_index);
+  auto slices_map  = move (m_slices);
+  m_file.Close ();
+  if (! MoveFileExA (tmp.c_str (), m_path.c_str (), MOVEFILE_REPLACE_EXISTING))
+  {
+    remove (tmp.c_str ());
+    Map ();
+    m_index       = move (index);
+    m_timelines   = move (timelines);
+    m_strings     = move (strings);
+    m_texts_index = move (texts_index);
+    m_slices      = move (slices_map);
+    return false;
+  }
+#else
+  if (rename (tmp.c_str (), m_path.c_str ()) != 0)
+  {
+    remove (tmp.c_str ());
+    return false;
+  }
+#endif
+
+  m_added.clear ();
+  m_added_heap.clear ();
+  m_added_texts.clear ();
+  m_dirty = false;
+  return Map ();
+}
+
+void EPGStore::Add (const View & e)
+{
+  P8PLATFORM::CLockObject lock (m_mutex);
+
+  Record r;
+  memset (&r, 0, sizeof (Record));
+  r.broadcast   = e.broadcast;
+  r.channel     = e.channel;
+  r.start       = e.start;
+  r.duration    = e.duration;
+  r.category    = e.category;
+  r.season      = e.season;
+  r.episode     = e.episode;
+  r.year        = e.year;
+  r.flags       = e.extended ? Record::EXTENDED : 0;
+  r.title       = Append (e.title);
+  r.subtitle    = Append (e.subtitle);
+  r.outline     = Pack   (e.outline);
+  r.plot        = Pack   (e.plot);
+  r.picture     = Append (e.picture);
+  r.actors      = Append (e.actors);
+  r.director    = Append (e.director);
+  r.fingerprint = e.fingerprint;
+
+  // Replaces any previous version.
+  auto f = m_index.find (r.broadcast);
+  if (f != m_index.end ())
+  {
+    if (r.fingerprint == 0) r.fingerprint = At (f->second).fingerprint;
+    Unindex (f->second);
+  }
+
+  size_t i = m_count + m_added.size ();
+  m_index [r.broadcast] = i;
+  m_added.push_back (r);
+  Index (i);
+  m_dirty = true;
+}
+
+bool EPGStore::Remove (uint32_t broadcast)
+{
+  P8PLATFORM::CLockObject lock (m_mutex);
+  auto f = m_index.find (broadcast);
+  if (f == m_index.end ()) return false;
+
+  Unindex (f->second);
+  m_index.erase (f);
+  m_dirty = true;
+  return true;
+}
+
+bool EPGStore::RemoveIf (uint32_t broadcast, time_t start, time_t end)
+{
+  P8PLATFORM::CLockObject lock (m_mutex);
+  auto f = m_index.find (broadcast);
+  if (f == m_index.end ()) return false;
+
+  const Record & r = At (f->second);
+  if (r.start < start || r.start >= end) return false;
+
+  Unindex (f->second);
+  m_index.erase (f);
+  m_dirty = true;
+  return true;
+}
+
+bool EPGStore::Find (uint32_t broadcast, Entry * e) const
+{
+  P8PLATFORM::CLockObject lock (m_mutex);
+  auto f = m_index.find (broadcast);
+  if (f == m_index.end ()) return false;
+
+  *e = Get (At (f->second));
+  return true;
+}
+
+uint32_t EPGStore::Fingerprint (uint32_t broadcast) const
+{
+  P8PLATFORM::CLockObject lock (m_mutex);
+  auto f = m_index.find (broadcast);
+  return f != m_index.end () ? At (f->second).fingerprint : 0;
+}
+
+void EPGStore::Find (uint32_t channel, time_t start, time_t end, const Callback & callback) const
+{
+  vector<Entry> entries;
+
+  {
+    P8PLATFORM::CLockObject lock (m_mutex);
+
+    auto f = m_timelines.find (channel);
+    if (f != m_timelines.end ())
+    {
+      const Timeline & t = f->second;
+
+      // Nothing starting before 'start - longest' can overlap.
+      int64_t from = (int64_t) start - t.longest;
+      auto i = lower_bound (t.intervals.begin (), t.intervals.end (), from,
+                            [] (const Interval & a, int64_t s) {return a.start < s;});
+
+      for (; i != t.intervals.end () && i->start < end; ++i)
+        if (i->end > start)
+          entries.push_back (Get (At (i->record)));
+    }
+  }
+
+  for (const Entry & e : entries)
+    callback (e);
+}
+
+void EPGStore::FindStarting (time_t start, time_t end, bool basic, const Callback & callback) const
+{
+  vector<Entry> entries;
+
+  {
+    P8PLATFORM::CLockObject lock (m_mutex);
+
+    for (auto & c : m_timelines)
+    {
+      const vector<Interval> & v = c.second.intervals;
+      auto i = lower_bound (v.begin (), v.end (), (int64_t) start,
+                            [] (const Interval & a, int64_t s) {return a.start < s;});
+
+      for (; i != v.end () && i->start < end; ++i)
+      {
+        const Record & r = At (i->record);
+        if (! basic || ! (r.flags & Record::EXTENDED))
+          entries.push_back (Get (r));
+      }
+    }
+  }
+
+  for (const Entry & e : entries)
+    callback (e);
+}
+
+time_t EPGStore::Fetched (time_t slice) const
+{
+  P8PLATFORM::CLockObject lock (m_mutex);
+  auto f = m_slices.find (slice);
+  return f != m_slices.end () ? f->second : 0;
+}
+
+void EPGStore::SetSlice (time_t slice, time_t now)
+{
+  P8PLATFORM::CLockObject lock (m_mutex);
+  m_slices [slice] = now;
+  m_dirty = true;
+}
+
+size_t EPGStore::Count () const
+{
+  P8PLATFORM::CLockObject lock (m_mutex);
+  return m_index.size ();
+}
+
+time_t EPGStore::Trim (size_t budget, time_t now, time_t horizon)
+{
+  P8PLATFORM::CLockObject lock (m_mutex);
+  Stats s = Usage ();
+  if (s.bytes <= budget) return 0;
+
+  // What each step could evict: no rewrite for nothing.
+  size_t expired = 0;
+  size_t texts   = 0;
+  map<int64_t, size_t> sizes; // events after the horizon, by slice
+  for (auto & i : m_index)
+  {
+    const Record & r = At (i.second);
+    if (r.start + r.duration < now)
+      ++expired;
+    else if (r.start >= horizon)
+    {
+      if (r.outline != 0 || r.plot != 0) ++texts;
+
+      size_t & size = sizes [r.start - r.start % 3600];
+      size += sizeof (Record) + sizeof (Interval);
+      for (uint32_t o : {r.title, r.subtitle, r.picture, r.actors, r.director})
+        size += strlen (String (o));
+    }
+  }
+
+  // Past events (and superseded records).
+  if (expired > 0 || s.records > s.events)
+  {
+    Write (now, EPG_NEVER, EPG_NEVER);
+    s = Usage ();
+    if (s.bytes <= budget) return 0;
+  }
+
+  // Texts of events after the horizon.
+  if (texts > 0)
+  {
+    Write (now, horizon, EPG_NEVER);
+    s = Usage ();
+    if (s.bytes <= budget) return 0;
+  }
+
+  // Events after the horizon, by slice (farthest first).
+  size_t excess = s.bytes - budget;
+  time_t drop   = 0;
+  for (auto i = sizes.rbegin (); i != sizes.rend () && excess > 0; ++i)
+  {
+    drop    = i->first;
+    excess -= min (excess, i->second);
+  }
+
+  if (drop != 0)
+    Write (now, horizon, drop);
+
+  return drop;
+}
+
+EPGStore::Stats EPGStore::GetStats () const
+{
+  P8PLATFORM::CLockObject lock (m_mutex);
+  return Usage ();
+}
+
+EPGStore::Stats EPGStore::Usage () const
+{
+  Stats s;
+  s.events  = m_index.size ();
+  s.records = m_count + m_added.size ();
+  s.strings = m_strings.size ();
+  s.heap    = m_heap_size + m_added_heap.size ();
+  s.texts   = m_texts_size + m_added_texts.size ();
+  s.bytes   = s.records * sizeof (Record) + s.heap + s.texts;
+
+  // Hash nodes: key, value, next pointer (buckets aside).
+  s.bytes += m_strings.size ()     * (sizeof (size_t) + sizeof (uint32_t) + sizeof (void *));
+  s.bytes += m_texts_index.size () * (sizeof (size_t) + sizeof (uint32_t) + sizeof (void *));
+  s.bytes += m_index.size ()   * (sizeof (uint32_t) + sizeof (size_t) + sizeof (void *));
+  for (auto & t : m_timelines)
+    s.bytes += t.second.intervals.size () * sizeof (Interval);
+
+  m_peak = max (m_peak, s.bytes);
+  s.peak = m_peak;
+  return s;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// E P G C A C H E /////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+EPGCache::EPGCache (size_t capacity) :
+  m_capacity (max<size_t> (capacity, 1)),
+  m_entries (),
+  m_index ()
+{
+}
+
+void EPGCache::Put (const EPGStore::View & e)
+{
+  auto f = m_index.find (e.broadcast);
+  if (f != m_index.end ())
+    m_entries.erase (f->second);
+
+  m_entries.emplace_front (e);
+  m_index [e.broadcast] = m_entries.begin ();
+
+  if (m_entries.size () > m_capacity)
+  {
+    m_index.erase (m_entries.back ().broadcast);
+    m_entries.pop_back ();
+  }
+}
+
+bool EPGCache::Get (uint32_t broadcast, EPGStore::Entry * e)
+{
+  auto f = m_index.find (broadcast);
+  if (f == m_index.end ()) return false;
+
+  // Most recently used.
+  m_entries.splice (m_entries.begin (), m_entries, f->second);
+  *e = *f->second;
+  return true;
+}
+
+void EPGCache::Erase (uint32_t broadcast)
+{
+  auto f = m_index.find (broadcast);
+  if (f == m_index.end ()) return;
+
+  m_entries.erase (f->second);
+  m_index.erase (f);
+}
+
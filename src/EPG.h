@@ -0,0 +1,305 @@
+#pragma once
+/*
+ *      Copyright (C) 2018 Aassif Benassarou
+ *      http://github.com/aassif/pvr.freebox/
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <list>
+#include <unordered_map>
+#include <functional>
+#include <ctime>
+#include <cstdint>
+#include "p8-platform/threads/mutex.h"
+#include "zlib.h"
+
+// Read-only file, mapped in memory.
+class EPGFile
+{
+  private:
+    const char * m_data;
+    size_t       m_size;
+#ifdef TARGET_WINDOWS
+    void *       m_file;
+    void *       m_mapping;
+#endif
+
+  public:
+    EPGFile ();
+    ~EPGFile ();
+
+    bool Open  (const std::string & path);
+    void Close ();
+
+    const char * Data () const {return m_data;}
+    size_t       Size () const {return m_size;}
+};
+
+// Set of broadcast ids (open addressing, linear probing).
+class EPGSet
+{
+  private:
+    std::vector<uint32_t> m_slots; // 0 = empty
+    size_t                m_size;
+    bool                  m_zero;  // 0 is a valid id too
+
+  protected:
+    void Grow ();
+
+  public:
+    EPGSet (size_t capacity = 1024);
+
+    // False if already there.
+    bool Insert (uint32_t);
+    bool Contains (uint32_t) const;
+    void Clear ();
+
+    size_t Size () const {return m_size + (m_zero ? 1 : 0);}
+};
+
+// Persistent EPG: fixed-size records (sorted by channel, then start time),
+// a string heap and a text heap (plots and outlines, deflated), mapped from
+// disk. Events added since the last Save () are kept in memory and override
+// mapped ones.
+class EPGStore
+{
+  public:
+    // Event, as stored (strings are offsets in the heap, texts in the text heap, 0 = empty).
+    struct Record
+    {
+      enum {EXTENDED = 1};
+
+      uint32_t broadcast;
+      uint32_t channel;
+      int64_t  start;
+      int32_t  duration;
+      int32_t  category;
+      int32_t  season;
+      int32_t  episode;
+      int32_t  year;
+      uint32_t flags;
+      uint32_t title;
+      uint32_t subtitle;
+      uint32_t outline;
+      uint32_t plot;
+      uint32_t picture;
+      uint32_t actors;
+      uint32_t director;
+      uint32_t fingerprint; // see Hash ()
+    };
+
+    class View;
+
+    // Event, as added / retrieved.
+    class Entry
+    {
+      public:
+        uint32_t    broadcast;
+        uint32_t    channel;
+        time_t      start;
+        int         duration;
+        int         category;
+        int         season;
+        int         episode;
+        int         year;
+        bool        extended;
+        uint32_t    fingerprint; // 0 = unknown
+        std::string title;
+        std::string subtitle;
+        std::string outline;
+        std::string plot;
+        std::string picture;
+        std::string actors;
+        std::string director;
+
+      public:
+        Entry ();
+        explicit Entry (const View &);
+    };
+
+    // Event, as added (strings are NUL-terminated views, not owned).
+    class View
+    {
+      public:
+        uint32_t         broadcast;
+        uint32_t         channel;
+        time_t           start;
+        int              duration;
+        int              category;
+        int              season;
+        int              episode;
+        int              year;
+        bool             extended;
+        uint32_t         fingerprint; // 0 = keep the previous one
+        std::string_view title;
+        std::string_view subtitle;
+        std::string_view outline;
+        std::string_view plot;
+        std::string_view picture;
+        std::string_view actors;
+        std::string_view director;
+
+      public:
+        View ();
+        View (const Entry &);
+    };
+
+    typedef std::function<void (const Entry &)> Callback;
+
+    // Memory usage (debug).
+    struct Stats
+    {
+      size_t events;  // live
+      size_t records; // including superseded ones, until the next Save ()
+      size_t strings; // distinct
+      size_t heap;    // bytes
+      size_t texts;   // bytes (deflated)
+      size_t bytes;   // records + heaps + indexes (approximately)
+      size_t peak;    // high-water mark of 'bytes'
+    };
+
+  protected:
+    // Live record, on a channel timeline.
+    struct Interval
+    {
+      int64_t start;
+      int64_t end;
+      size_t  record;
+    };
+
+    // Intervals sorted by start time.
+    struct Timeline
+    {
+      std::vector<Interval> intervals;
+      int64_t               longest; // duration
+    };
+
+  private:
+    mutable P8PLATFORM::CMutex m_mutex;
+    std::string m_path;
+    // Mapped data.
+    EPGFile         m_file;
+    const Record *  m_records;
+    size_t          m_count;
+    const char *    m_heap;
+    size_t          m_heap_size;
+    const char *    m_texts;
+    size_t          m_texts_size;
+    // Added data (offsets start after the mapped heaps).
+    std::vector<Record> m_added;
+    std::string         m_added_heap;
+    std::string         m_added_texts;
+    // Heap offsets by string hash (each string is stored once).
+    std::unordered_multimap<size_t, uint32_t> m_strings;
+    // Text heap offsets by hash of the deflated bytes (same).
+    std::unordered_multimap<size_t, uint32_t> m_texts_index;
+    // Raw deflate streams, with a preset dictionary.
+    z_stream         m_deflate;
+    mutable z_stream m_inflate;
+    std::string      m_scratch;
+    // Record by broadcast id: mapped (< m_count), added (>= m_count).
+    std::unordered_map<uint32_t, size_t> m_index;
+    // Interval index, by channel.
+    std::unordered_map<uint32_t, Timeline> m_timelines;
+    // Slices (time -> last fetch).
+    std::map<int64_t, int64_t> m_slices;
+    bool m_dirty;
+    mutable size_t m_peak; // bytes
+
+  protected:
+    // NOT thread-safe !
+    bool             Map ();
+    const Record &   At (size_t) const;
+    const char *     String (uint32_t) const;
+    // Interned: an existing offset is returned if the string is known.
+    uint32_t         Append (std::string_view);
+    // Deflated text (interned as well), inflated on demand.
+    uint32_t         Pack   (std::string_view);
+    std::string      Unpack (uint32_t) const;
+    std::string_view Text   (uint32_t) const; // as stored
+    Entry            Get (const Record &) const;
+    void             Index   (size_t record);
+    void             Unindex (size_t record);
+    // Rewrites the file: expired events are dropped, as well as those
+    // starting after 'drop' (and their slices); those starting after
+    // 'strip' lose their texts.
+    bool             Write (time_t now, time_t strip, time_t drop);
+    Stats            Usage () const;
+
+  public:
+    // Basic fields fingerprint (never 0).
+    static uint32_t Hash (std::string_view title, std::string_view subtitle, int64_t start, int duration);
+
+  public:
+    EPGStore (const std::string & path);
+    ~EPGStore ();
+
+    // Mapped file (missing, outdated or corrupted = empty).
+    bool Load ();
+    // Rewrites the file: expired events and slices are dropped.
+    bool Save (time_t now);
+    // Evicts past events, then texts of events starting after 'horizon',
+    // then events starting after 'horizon' (farthest slices first) until
+    // under the budget. Nothing is rewritten if nothing can be evicted.
+    // Returns the first evicted slice (0 = none).
+    time_t Trim (size_t budget, time_t now, time_t horizon);
+
+    void Add    (const View &);
+    bool Remove (uint32_t broadcast);
+    // Only if it (still) starts in [start, end): checked and removed atomically.
+    bool RemoveIf (uint32_t broadcast, time_t start, time_t end);
+    bool Find   (uint32_t broadcast, Entry *) const;
+    // Fingerprint of a known event (0 = unknown).
+    uint32_t Fingerprint (uint32_t broadcast) const;
+    // Events overlapping [start, end) on a channel, by start time.
+    void Find (uint32_t channel, time_t start, time_t end, const Callback &) const;
+    // Events starting in [start, end), any channel (only those without extended details if 'basic').
+    void FindStarting (time_t start, time_t end, bool basic, const Callback &) const;
+
+    // Slices (/api/v6/tv/epg/by_time/*): last fetch (0 = never).
+    time_t Fetched  (time_t slice) const;
+    void   SetSlice (time_t slice, time_t now);
+
+    size_t Count () const;
+    Stats  GetStats () const;
+};
+
+// Extended details by broadcast id, least recently used dropped first.
+// NOT thread-safe !
+class EPGCache
+{
+  private:
+    typedef std::list<EPGStore::Entry> Entries;
+    size_t  m_capacity;
+    Entries m_entries; // most recent first
+    std::unordered_map<uint32_t, Entries::iterator> m_index;
+
+  public:
+    EPGCache (size_t capacity);
+
+    void Put   (const EPGStore::View &);
+    bool Get   (uint32_t broadcast, EPGStore::Entry *);
+    void Erase (uint32_t broadcast);
+
+    size_t Size () const {return m_entries.size ();}
+};
+
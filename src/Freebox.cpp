@@ -27,12 +27,19 @@
 #include <sstream>
 #include <fstream>
 #include <algorithm>
-#include <numeric> // accumulate
+#include <iterator> // istreambuf_iterator
+#include <tuple>
+#include <cstdio> // rename
+
+#ifdef TARGET_WINDOWS
+  #include <windows.h>
+#endif
 
 #undef major
 #undef minor
 
 #include "p8-platform/util/StringUtils.h"
+#include "p8-platform/util/timeutils.h"
 
 #include "client.h"
 #include "Freebox.h"
@@ -50,7 +57,7 @@ using namespace std;
 using namespace rapidjson;
 using namespace ADDON;
 
-#define PVR_FREEBOX_C_STR(s) s.empty () ? NULL : s.c_str ()
+#define PVR_FREEBOX_C_STR(s) (s.empty () ? NULL : s.data ())
 
 #define PVR_FREEBOX_TIMER_MANUAL     1
 #define PVR_FREEBOX_TIMER_EPG        2
@@ -58,6 +65,52 @@ using namespace ADDON;
 #define PVR_FREEBOX_GENERATOR_MANUAL 4
 #define PVR_FREEBOX_GENERATOR_EPG    5
 
+// HTTP rate (queries per second).
+#define PVR_FREEBOX_HTTP_RATE  2.0
+#define PVR_FREEBOX_HTTP_MAX  10.0
+#define PVR_FREEBOX_HTTP_BURST 4.0
+
+// Channel snapshot (binary, native byte order).
+#define PVR_FREEBOX_CHANNELS_FILE    "channels.bin"
+#define PVR_FREEBOX_CHANNELS_MAGIC   0x43584246 // "FBXC"
+#define PVR_FREEBOX_CHANNELS_VERSION 1
+
+// Channel preferences (journal).
+#define PVR_FREEBOX_PREFS_FILE "prefs.txt"
+
+// Stream outcomes.
+#define PVR_FREEBOX_HEALTH_FILE "streams.bin"
+
+// EPG store.
+#define PVR_FREEBOX_EPG_FILE "epg.bin"
+
+// Extended details (LRU capacity).
+#define PVR_FREEBOX_EPG_DETAILS 2048
+
+// EPG slot lifetime: late changes are more likely in the next few hours.
+#define PVR_FREEBOX_EPG_NEAR     (3 * 60 * 60)
+#define PVR_FREEBOX_EPG_TTL_NEAR (1 * 60 * 60)
+#define PVR_FREEBOX_EPG_TTL_FAR  (12 * 60 * 60)
+#define PVR_FREEBOX_EPG_FAR      (24 * 60 * 60) // evicted first (memory budget)
+
+// Stream scores: [wanted][offered] (AUTO, IPTV, DVB).
+static constexpr int PVR_FREEBOX_SOURCE_SCORES [3][3] =
+{
+  {100,  10,   1},
+  { 10, 100,   1},
+  { 10,   1, 100}
+};
+
+// Stream scores: [wanted][offered] (AUTO, HD, SD, LD, 3D).
+static constexpr int PVR_FREEBOX_QUALITY_SCORES [5][5] =
+{
+  {1000,  100,   10,    1,    0},
+  { 100, 1000,   10,    1,    0},
+  { 100,    1, 1000,   10,    0},
+  { 100,    1,   10, 1000,    0},
+  {   0,    0,    0,    0, 1000}
+};
+
 inline
 void freebox_debug (const Value & data)
 {
@@ -89,12 +142,14 @@ string freebox_base64 (const char * buffer, unsigned int length)
 }
 
 inline
-int freebox_http (const string & custom, const string & url, const string & request, string * response, const string & session)
+int freebox_http (const string & custom, const string & url, const string & request, const string & session, const Freebox::Parser & parse)
 {
   // URL.
   void * f = XBMC->CURLCreate (url.c_str ());
   // Custom request.
   XBMC->CURLAddOption (f, XFILE::CURL_OPTION_PROTOCOL, "customrequest", custom.c_str ());
+  // Compression (decoded by CURL).
+  XBMC->CURLAddOption (f, XFILE::CURL_OPTION_PROTOCOL, "acceptencoding", "gzip, deflate");
   // Header.
   if (! session.empty ())
     XBMC->CURLAddOption (f, XFILE::CURL_OPTION_HEADER, "X-Fbx-App-Auth", session.c_str ());
@@ -106,20 +161,52 @@ int freebox_http (const string & custom, const string & url, const string & requ
   }
   // Perform HTTP query.
   if (! XBMC->CURLOpen (f, XFILE::READ_NO_CACHE))
+  {
+    XBMC->CloseFile (f);
     return -1;
-  // Read HTTP response.
-  char buffer [1024];
-  while (int size = XBMC->ReadFile (f, buffer, 1024))
-    response->append (buffer, size);
+  }
+  // Parse HTTP response.
+  HTTPStream is ([f] (char * buffer, size_t size) {return (ssize_t) XBMC->ReadFile (f, buffer, size);});
+  parse (is);
   // HTTP status code.
   string header = XBMC->GetFilePropertyValue (f, XFILE::FILE_PROPERTY_RESPONSE_PROTOCOL, "");
   istringstream iss (header); string protocol; int status;
-  if (! (iss >> protocol >> status >> ws)) return -1;
+  if (! (iss >> protocol >> status >> ws)) status = -1;
   // Cleanup.
   XBMC->CloseFile (f);
   return status;
 }
 
+// Same as above, over a keep-alive connection.
+// Returns -1 if the transport failed (before anything was parsed).
+inline
+int freebox_http (HTTPPool & pool, const string & custom, const string & path, const string & request, const string & session, const Freebox::Parser & parse)
+{
+  HTTPConnection::Headers headers;
+  if (! session.empty ())
+    headers.emplace_back ("X-Fbx-App-Auth", session);
+
+  bool reused = false;
+  HTTPPool::Connection c = pool.Acquire (&reused);
+  if (! c) return -1;
+
+  // An idle connection may have been closed by the server: retry once.
+  if (! c->Request (custom, path, headers, request))
+  {
+    if (! reused) return -1;
+    c = pool.Acquire (&reused, true);
+    if (! c || ! c->Request (custom, path, headers, request)) return -1;
+  }
+
+  // Parse HTTP response.
+  HTTPStream is ([&c] (char * buffer, size_t size) {return c->Read (buffer, size);});
+  parse (is);
+
+  int status = c->Status ();
+  pool.Release (move (c));
+  return status;
+}
+
 /* static */
 enum Freebox::Source Freebox::ParseSource (const string & s)
 {
@@ -166,11 +253,10 @@ string Freebox::StrQuality (enum Quality q)
   }
 }
 
-/* static */
-bool Freebox::HTTP (const string & custom,
-                    const string & path,
-                    const Document & request,
-                    Document * doc, Type type) const
+int Freebox::HTTP (const string & custom,
+                   const string & path,
+                   const Document & request,
+                   const Parser & parse)
 {
   m_mutex.Lock ();
   string url = URL (path);
@@ -184,11 +270,59 @@ bool Freebox::HTTP (const string & custom,
     request.Accept (writer);
   }
 
-  string response;
-  long http = freebox_http (custom, url, buffer.GetString (), &response, session);
-  XBMC->Log (LOG_DEBUG, "%s %s %s", custom.c_str (), url.c_str (), response.c_str ());
+  // Rate limiting.
+  if (! m_limiter.Acquire ()) return -1;
+
+  // Latency (time to first byte).
+  int64_t start   = P8PLATFORM::GetTimeMs ();
+  int64_t latency = -1;
+  auto timed = [&] (HTTPStream & is)
+  {
+    latency = P8PLATFORM::GetTimeMs () - start;
+    parse (is);
+  };
+
+  int http = freebox_http (m_http, custom, path, buffer.GetString (), session, timed);
+  if (http < 0)
+  {
+    // Fallback: Kodi's CURL.
+    http = freebox_http (custom, url, buffer.GetString (), session, timed);
+  }
+  XBMC->Log (LOG_DEBUG, "%s %s (HTTP %d, %d ms)", custom.c_str (), url.c_str (), http, (int) latency);
+
+  if (http < 0 || http == 429 || http >= 500)
+    m_limiter.Failure ();
+  else
+    m_limiter.Success (latency);
+
+  return http;
+}
+
+// Only once the request has really failed (an expired session is retried first),
+// with a Freebox reply (parsed).
+inline
+void freebox_http_error (const string & custom, const string & path, int http)
+{
+  if (http > 0 && http != 200)
+  {
+    XBMC->QueueNotification (QUEUE_INFO, "HTTP %d", http);
+    XBMC->Log (LOG_ERROR, "HTTP %d : %s %s", http, custom.c_str (), path.c_str ());
+  }
+}
+
+/* static */
+bool Freebox::HTTP (const string & custom,
+                    const string & path,
+                    const Document & request,
+                    Document * doc, Type type)
+{
+  string session = SessionToken ();
+  auto   parse   = [doc] (HTTPStream & is) {doc->ParseStream (is);};
+  int    http    = HTTP (custom, path, request, parse);
 
-  doc->Parse (response);
+  // Expired session: renew it, then try again (once).
+  if (doc->IsObject () && RenewSession (path, session, JSON<string> (*doc, "error_code")))
+    http = HTTP (custom, path, request, parse);
 
   if (doc->HasParseError ()) return false;
 
@@ -197,6 +331,8 @@ bool Freebox::HTTP (const string & custom,
   auto s = doc->FindMember ("success");
   if (s == doc->MemberEnd ()) return false;
 
+  freebox_http_error (custom, path, http);
+
   bool success = s->value.GetBool ();
   if (success && type != kNullType)
   {
@@ -204,19 +340,12 @@ bool Freebox::HTTP (const string & custom,
     if (r == doc->MemberEnd () || r->value.GetType () != type) return false;
   }
 
-  if (http != 200)
-  {
-    XBMC->QueueNotification (QUEUE_INFO, "HTTP %d", http);
-    cout << "HTTP " << http << " : " << response << endl;
-    return false;
-  }
-
-  return success;
+  return http == 200 && success;
 }
 
 /* static */
 bool Freebox::GET (const string & path,
-                   Document * doc, Type type) const
+                   Document * doc, Type type)
 {
   return HTTP ("GET", path, Document (), doc, type);
 }
@@ -224,7 +353,7 @@ bool Freebox::GET (const string & path,
 /* static */
 bool Freebox::POST (const string & path,
                     const Document & request,
-                    Document * doc, Type type) const
+                    Document * doc, Type type)
 {
   return HTTP ("POST", path, request, doc, type);
 }
@@ -232,18 +361,218 @@ bool Freebox::POST (const string & path,
 /* static */
 bool Freebox::PUT (const string & path,
                    const Document & request,
-                   Document * doc, Type type) const
+                   Document * doc, Type type)
 {
   return HTTP ("PUT", path, request, doc, type);
 }
 
 /* static */
 bool Freebox::DELETE (const string & path,
-                      Document * doc) const
+                      Document * doc)
 {
   return HTTP ("DELETE", path, Document (), doc, kNullType);
 }
 
+// SAX handler: every value found 'level' levels below "result" is rebuilt
+// (and handed over) on its own, as soon as it has been parsed. Memory usage
+// is bounded by the size of a single record, not by the size of the response.
+class Freebox::RecordReader :
+  public BaseReaderHandler<UTF8<>, Freebox::RecordReader>
+{
+  private:
+    int             m_level;
+    const Records & m_records;
+    // Envelope.
+    int             m_depth;   // number of open containers
+    string          m_key;     // last top-level key
+    bool            m_success;
+    string          m_error;
+    // Path from "result".
+    int             m_result;  // depth of "result" (-1 outside)
+    Keys            m_keys;
+    string          m_pending; // key of the next value
+    // Current record.
+    bool                   m_building;
+    MemoryPoolAllocator<>  m_allocator;
+    vector<Value>          m_values;
+    vector<size_t>         m_frames;
+
+  protected:
+    // Start of a value: does it belong to a record?
+    bool Begin (bool container)
+    {
+      if (m_building) return true;
+
+      bool result = (m_result < 0 && m_depth == 1 && m_key == "result");
+      bool inside = (m_result > 0 && m_depth >= m_result);
+      int  level  = result ? 0 : (inside ? m_depth - m_result + 1 : -1);
+
+      // Array items have no key.
+      string key;
+      key.swap (m_pending);
+
+      if (level == m_level)
+      {
+        if (m_level > 0) m_keys.push_back (key);
+        m_building = true;
+        return true;
+      }
+
+      if (container)
+      {
+        if (result) m_result = m_depth + 1;
+        if (inside) m_keys.push_back (key);
+      }
+
+      return false;
+    }
+
+    // End of a container (outside records).
+    bool End ()
+    {
+      if (m_result > 0 && m_depth > m_result) m_keys.pop_back ();
+      if (m_depth == m_result) m_result = 0;
+      --m_depth;
+      return true;
+    }
+
+    // End of a value (inside a record).
+    bool Push (Value && v)
+    {
+      m_values.push_back (move (v));
+      if (m_frames.empty ())
+      {
+        m_records (m_keys, m_values.back ());
+        if (m_level > 0) m_keys.pop_back ();
+        m_values.clear ();
+        m_allocator.Clear ();
+        m_building = false;
+      }
+      return true;
+    }
+
+    template <typename T>
+    bool Scalar (T t)
+    {
+      return Begin (false) ? Push (Value (t)) : true;
+    }
+
+  public:
+    RecordReader (int level, const Records & records) :
+      m_level (level),
+      m_records (records),
+      m_depth (0),
+      m_key (),
+      m_success (false),
+      m_error (),
+      m_result (-1),
+      m_keys (),
+      m_pending (),
+      m_building (false),
+      m_allocator (),
+      m_values (),
+      m_frames ()
+    {
+    }
+
+    bool           Success () const {return m_success;}
+    const string & Error   () const {return m_error;}
+
+    bool Null   ()           {return Begin (false) ? Push (Value ()) : true;}
+    bool Bool   (bool b)     {if (m_depth == 1 && m_key == "success") m_success = b; return Scalar (b);}
+    bool Int    (int i)      {return Scalar (i);}
+    bool Uint   (unsigned u) {return Scalar (u);}
+    bool Int64  (int64_t i)  {return Scalar (i);}
+    bool Uint64 (uint64_t u) {return Scalar (u);}
+    bool Double (double d)   {return Scalar (d);}
+
+    bool String (const char * s, SizeType length, bool)
+    {
+      if (m_depth == 1 && m_key == "error_code") m_error.assign (s, length);
+      return Begin (false) ? Push (Value (s, length, m_allocator)) : true;
+    }
+
+    bool Key (const char * s, SizeType length, bool)
+    {
+      if (m_building)
+        m_values.emplace_back (s, length, m_allocator);
+      else if (m_depth == 1)
+        m_key.assign (s, length);
+      else
+        m_pending.assign (s, length);
+      return true;
+    }
+
+    bool StartObject ()
+    {
+      if (Begin (true))
+        m_frames.push_back (m_values.size ());
+      else
+        ++m_depth;
+      return true;
+    }
+
+    bool EndObject (SizeType)
+    {
+      if (! m_building) return End ();
+
+      size_t first = m_frames.back (); m_frames.pop_back ();
+      Value object (kObjectType);
+      for (size_t i = first; i + 1 < m_values.size (); i += 2)
+        object.AddMember (m_values[i], m_values[i + 1], m_allocator);
+      m_values.resize (first);
+      return Push (move (object));
+    }
+
+    bool StartArray ()
+    {
+      return StartObject ();
+    }
+
+    bool EndArray (SizeType)
+    {
+      if (! m_building) return End ();
+
+      size_t first = m_frames.back (); m_frames.pop_back ();
+      Value array (kArrayType);
+      array.Reserve (m_values.size () - first, m_allocator);
+      for (size_t i = first; i < m_values.size (); ++i)
+        array.PushBack (m_values[i], m_allocator);
+      m_values.resize (first);
+      return Push (move (array));
+    }
+};
+
+/* static */
+bool Freebox::GET (const string & path,
+                   int level, const Records & records)
+{
+  string session = SessionToken ();
+  bool   parsed  = false;
+  bool   success = false;
+  string error;
+  auto parse = [&] (HTTPStream & is)
+  {
+    RecordReader handler (level, records);
+    Reader reader;
+    parsed  = ! reader.Parse (is, handler).IsError ();
+    success = handler.Success ();
+    error   = handler.Error ();
+  };
+
+  int http = HTTP ("GET", path, Document (), parse);
+
+  // Expired session: renew it, then try again (once).
+  if (RenewSession (path, session, error))
+    http = HTTP ("GET", path, Document (), parse);
+
+  if (! parsed) return false;
+
+  freebox_http_error ("GET", path, http);
+
+  return http == 200 && success;
+}
+
 /* static */
 string Freebox::Password (const string & token, const string & challenge)
 {
@@ -265,7 +594,8 @@ string Freebox::Password (const string & token, const string & challenge)
 
 bool Freebox::StartSession ()
 {
-  P8PLATFORM::CLockObject lock (m_mutex);
+  // Logins are serialized, but never block m_mutex.
+  P8PLATFORM::CLockObject lock (m_session_mutex);
 
   if (m_app_token.empty ())
   {
@@ -307,11 +637,7 @@ bool Freebox::StartSession ()
     //cout << "track_id: " << m_track_id << endl;
   }
 
-  Document login;
-  if (! GET ("/api/v6/login/", &login))
-    return false;
-
-  if (! login["result"]["logged_in"].GetBool ())
+  if (SessionToken ().empty ())
   {
     Document d;
     string track = to_string (m_track_id);
@@ -333,9 +659,13 @@ bool Freebox::StartSession ()
 
       Document response;
       if (! POST ("/api/v6/login/session", request, &response)) return false;
-      m_session_token = JSON<string> (response["result"], "session_token");
+      string session = JSON<string> (response["result"], "session_token");
+
+      m_mutex.Lock ();
+      m_session_token = session;
+      m_mutex.Unlock ();
 
-      cout << "StartSession: session_token: " << m_session_token << endl;
+      cout << "StartSession: session_token: " << session << endl;
       return true;
     }
     else
@@ -350,80 +680,39 @@ bool Freebox::StartSession ()
   return true;
 }
 
-bool Freebox::CloseSession ()
+string Freebox::SessionToken () const
 {
-  if (! m_session_token.empty ())
-  {
-    Document response;
-    return POST ("/api/v6/login/logout/", Document (), &response, kNullType);
-  }
-
-  return true;
+  P8PLATFORM::CLockObject lock (m_mutex);
+  return m_session_token;
 }
 
-class Conflict
+bool Freebox::RenewSession (const string & path, const string & session, const string & error)
 {
-  public:
-    string uuid;
-    int major, minor; // numéro de chaîne
-    int position;     // position dans le bouquet
+  // Login queries don't need a session.
+  if (path.compare (0, 14, "/api/v6/login/") == 0) return false;
 
-  public:
-    inline Conflict (const string & id,
-                     int n1, int n2,
-                     int p) :
-      uuid (id),
-      major (n1), minor (n2),
-      position (p)
-    {
-    }
-};
+  if (error != "auth_required" && error != "invalid_session") return false;
 
-class ConflictComparator
-{
-  public:
-    inline bool operator() (const Conflict & c1, const Conflict & c2) const
-    {
-      return tie (c1.major, c1.minor) < tie (c2.major, c2.minor);
-    }
-};
+  P8PLATFORM::CLockObject lock (m_session_mutex);
 
-inline string StrUUIDs (const vector<Conflict> & v)
-{
-  string text;
-  if (! v.empty ())
-  {
-    text += v[0].uuid;
-    for (size_t i = 1; i < v.size (); ++i)
-      text += ", " + v[i].uuid;
-  }
-  return '[' + text + ']';
-}
+  // Unless another thread already did it.
+  m_mutex.Lock ();
+  if (m_session_token == session)
+    m_session_token.clear ();
+  m_mutex.Unlock ();
 
-inline string StrNumber (const Conflict & c, bool minor)
-{
-  return to_string (c.major) + (minor ? '.' + to_string (c.minor) : "");
+  return StartSession ();
 }
 
-inline string StrNumbers (const vector<Conflict> & v)
+bool Freebox::CloseSession ()
 {
-  string text;
-  switch (v.size ())
+  if (! SessionToken ().empty ())
   {
-    case 0:
-      break;
-
-    case 1:
-      text = StrNumber (v[0], false);
-      break;
-
-    default:
-      text = StrNumber (v[0], true);
-      for (size_t i = 1; i < v.size (); ++i)
-        text += ", " + StrNumber (v[i], true);
-      break;
+    Document response;
+    return POST ("/api/v6/login/logout/", Document (), &response, kNullType);
   }
-  return '[' + text + ']';
+
+  return true;
 }
 
 Freebox::Stream::Stream (enum Source  source,
@@ -437,90 +726,14 @@ Freebox::Stream::Stream (enum Source  source,
 
 int Freebox::Stream::score (enum Source s) const
 {
-  switch (s)
-  {
-    case Source::AUTO:
-      switch (source)
-      {
-        case Source::AUTO: return 100;
-        case Source::IPTV: return 10;
-        case Source::DVB:  return 1;
-        default:           return 0;
-      }
-
-    case Source::IPTV:
-      switch (source)
-      {
-        case Source::AUTO: return 10;
-        case Source::IPTV: return 100;
-        case Source::DVB:  return 1;
-        default:           return 0;
-      }
-
-    case Source::DVB:
-      switch (source)
-      {
-        case Source::AUTO: return 10;
-        case Source::IPTV: return 1;
-        case Source::DVB:  return 100;
-        default:           return 0;
-      }
-
-    default:
-      return 0;
-  }
+  int i = (int) s, j = (int) source;
+  return 0 <= i && i < 3 && 0 <= j && j < 3 ? PVR_FREEBOX_SOURCE_SCORES [i][j] : 0;
 }
 
 int Freebox::Stream::score (enum Quality q) const
 {
-  switch (q)
-  {
-    case Quality::AUTO:
-      switch (quality)
-      {
-        case Quality::AUTO: return 1000;
-        case Quality::HD:   return 100;
-        case Quality::SD:   return 10;
-        case Quality::LD:   return 1;
-        default:            return 0;
-      }
-
-    case Quality::HD:
-      switch (quality)
-      {
-        case Quality::AUTO: return 100;
-        case Quality::HD:   return 1000;
-        case Quality::SD:   return 10;
-        case Quality::LD:   return 1;
-        default:            return 0;
-      }
-
-    case Quality::SD:
-      switch (quality)
-      {
-        case Quality::AUTO: return 100;
-        case Quality::HD:   return 1;
-        case Quality::SD:   return 1000;
-        case Quality::LD:   return 10;
-        default:            return 0;
-      }
-
-    case Quality::LD:
-      switch (quality)
-      {
-        case Quality::AUTO: return 100;
-        case Quality::HD:   return 1;
-        case Quality::SD:   return 10;
-        case Quality::LD:   return 1000;
-        default:            return 0;
-      }
-
-    case Quality::STEREO:
-      return (quality == Quality::STEREO) ? 1000 : 0;
-
-    default:
-      return 0;
-  }
+  int i = (int) q, j = (int) quality;
+  return 0 <= i && i < 5 && 0 <= j && j < 5 ? PVR_FREEBOX_QUALITY_SCORES [i][j] : 0;
 }
 
 int Freebox::Stream::score (enum Source s, enum Quality q) const
@@ -540,6 +753,23 @@ Freebox::Channel::Channel (const string & uuid,
   major (major), minor (minor),
   streams (streams)
 {
+  // Best stream for every (source, quality): first highest score.
+  for (int s = 0; s < 3; ++s)
+    for (int q = 0; q < 5; ++q)
+    {
+      int & index = best [s][q];
+      int   score = 0;
+      index = -1;
+      for (size_t i = 0; i < streams.size (); ++i)
+      {
+        int x = streams[i].score (Source (s), Quality (q));
+        if (index < 0 || x > score)
+        {
+          index = i;
+          score = x;
+        }
+      }
+    }
 }
 
 bool Freebox::Channel::IsHidden () const
@@ -547,20 +777,17 @@ bool Freebox::Channel::IsHidden () const
   return streams.empty ();
 }
 
-void Freebox::Channel::GetChannel (ADDON_HANDLE handle, bool radio) const
+void Freebox::Channel::GetChannel (PVR_CHANNEL * channel) const
 {
-  PVR_CHANNEL channel;
-  memset (&channel, 0, sizeof (PVR_CHANNEL));
-
-  channel.iUniqueId         = ChannelId (uuid);
-  channel.bIsRadio          = radio;
-  channel.iChannelNumber    = major;
-  channel.iSubChannelNumber = minor;
-  strncpy (channel.strChannelName, name.c_str (), PVR_ADDON_NAME_STRING_LENGTH - 1);
-  strncpy (channel.strIconPath,    logo.c_str (), PVR_ADDON_URL_STRING_LENGTH  - 1);
-  channel.bIsHidden         = IsHidden ();
+  memset (channel, 0, sizeof (PVR_CHANNEL));
 
-  PVR->TransferChannelEntry (handle, &channel);
+  channel->iUniqueId         = ChannelId (uuid);
+  channel->bIsRadio          = false;
+  channel->iChannelNumber    = major;
+  channel->iSubChannelNumber = minor;
+  strncpy (channel->strChannelName, name.c_str (), PVR_ADDON_NAME_STRING_LENGTH - 1);
+  strncpy (channel->strIconPath,    logo.c_str (), PVR_ADDON_URL_STRING_LENGTH  - 1);
+  channel->bIsHidden         = IsHidden ();
 }
 
 void freebox_debug_stream_properties (const string & url, int index, int score)
@@ -568,25 +795,39 @@ void freebox_debug_stream_properties (const string & url, int index, int score)
   XBMC->Log (LOG_DEBUG, "GetStreamProperties: '%s' (index = %d, score = %d)", url.c_str (), index, score);
 }
 
-PVR_ERROR Freebox::Channel::GetStreamProperties (enum Source source, enum Quality quality,
-                                                 PVR_NAMED_VALUE * properties, unsigned int * count) const
+int Freebox::Channel::BestStream (enum Source source, enum Quality quality, const StreamHealth & health) const
 {
-  if (! streams.empty ())
-  {
-    int index = 0;
-    int score = streams[0].score (source, quality);
-    freebox_debug_stream_properties (streams[0].url, index, score);
+  int s = (int) source, q = (int) quality;
+  int index = 0 <= s && s < 3 && 0 <= q && q < 5 ? best [s][q] : (streams.empty () ? -1 : 0);
 
-    for (size_t i = 1; i < streams.size (); ++i)
+  // Demoted streams come last, then by score (as usual), then by health.
+  if (index >= 0 && health.Penalized (ChannelId (uuid)))
+  {
+    tuple<bool, int, double> key;
+    index = -1;
+    for (size_t i = 0; i < streams.size (); ++i)
     {
-      int s = streams[i].score (source, quality);
-      freebox_debug_stream_properties (streams[i].url, i, s);
-      if (s > score)
+      const string & url = streams[i].url;
+      auto k = make_tuple (! health.Demoted (url), streams[i].score (source, quality), health.Factor (url));
+      if (index < 0 || k > key)
       {
         index = i;
-        score = s;
+        key   = k;
       }
     }
+  }
+
+  return index;
+}
+
+PVR_ERROR Freebox::Channel::GetStreamProperties (enum Source source, enum Quality quality, StreamHealth & health,
+                                                 PVR_NAMED_VALUE * properties, unsigned int * count) const
+{
+  int index = BestStream (source, quality, health);
+  if (index >= 0)
+  {
+    freebox_debug_stream_properties (streams[index].url, index, streams[index].score (source, quality));
+    health.Zap (ChannelId (uuid), streams[index].url);
 
     strncpy (properties[0].strName,  PVR_STREAM_PROPERTY_STREAMURL,         PVR_ADDON_NAME_STRING_LENGTH - 1);
     strncpy (properties[0].strValue, streams[index].url.c_str (),           PVR_ADDON_NAME_STRING_LENGTH - 1);
@@ -598,7 +839,7 @@ PVR_ERROR Freebox::Channel::GetStreamProperties (enum Source source, enum Qualit
   return PVR_ERROR_NO_ERROR;
 }
 
-string Freebox::Event::Native (int c)
+const char * Freebox::Event::Native (int c)
 {
   switch (c)
   {
@@ -654,14 +895,6 @@ int Freebox::Event::Colors (int c)
   };
 }
 
-Freebox::Event::CastMember::CastMember (const Value & c) :
-  job        (JSON<string> (c, "job")),
-  first_name (JSON<string> (c, "first_name")),
-  last_name  (JSON<string> (c, "last_name")),
-  role       (JSON<string> (c, "role"))
-{
-}
-
 Freebox::Event::Event (const Value & e, unsigned int channel, time_t date) :
   channel  (channel),
   uuid     (JSON<string> (e, "id")),
@@ -675,203 +908,283 @@ Freebox::Event::Event (const Value & e, unsigned int channel, time_t date) :
   picture  (JSON<string> (e, "picture_big", JSON<string> (e, "picture"))),
   plot     (JSON<string> (e, "desc")),
   outline  (JSON<string> (e, "short_desc")),
-  year     (JSON<int>    (e, "year")),
-  cast     ()
+  year     (JSON<int>    (e, "year"))
 {
   if (category != 0 && Colors (category) == 0)
   {
     string name = JSON<string> (e, "category_name");
     cout << category << " : " << name << endl;
   }
+}
+
+// View into the document (NUL-terminated).
+inline
+string_view freebox_view (const Value & json, const char * name, string_view value = string_view ())
+{
+  auto f = json.FindMember (name);
+  if (f == json.MemberEnd () || ! f->value.IsString ()) return value;
+  return string_view (f->value.GetString (), f->value.GetStringLength ());
+}
+
+// Actors and directors, in one pass (buffers are reused).
+inline
+void freebox_cast (const Value & event, string * actors, string * director)
+{
+  actors->clear ();
+  director->clear ();
+
+  auto f = event.FindMember ("cast");
+  if (f == event.MemberEnd () || ! f->value.IsArray ()) return;
 
-  auto f = e.FindMember ("cast");
-  if (f != e.MemberEnd ())
+  for (const Value & m : f->value.GetArray ())
   {
-    const Value & c = f->value;
-    if (c.IsArray ())
-      for (SizeType i = 0; i < c.Size (); ++i)
-        cast.emplace_back (c[i]);
+    string_view job = freebox_view (m, "job");
+    string * s = job == "Acteur"      ? actors   :
+                 job == "Réalisateur" ? director : nullptr;
+    if (! s) continue;
+
+    if (! s->empty ()) s->append (EPG_STRING_TOKEN_SEPARATOR);
+    s->append (freebox_view (m, "first_name")).append (1, ' ');
+    s->append (freebox_view (m, "last_name"));
   }
 }
 
-Freebox::Event::ConcatIfJob::ConcatIfJob (const string & job) :
-  m_job (job)
+inline
+void freebox_write (string * data, uint32_t n)
 {
+  data->append ((const char *) &n, sizeof (n));
 }
 
-string Freebox::Event::ConcatIfJob::operator() (const string & input, const Freebox::Event::CastMember & m) const
+inline
+void freebox_write (string * data, const string & s)
 {
-  if (m.job != m_job) return input;
-  return (input.empty () ? "" : input + EPG_STRING_TOKEN_SEPARATOR) + (m.first_name + ' ' + m.last_name);
+  freebox_write (data, (uint32_t) s.size ());
+  data->append (s);
 }
 
-string Freebox::Event::GetCastDirector () const
+inline
+bool freebox_read (const string & data, size_t * offset, uint32_t * n)
 {
-  static const ConcatIfJob CONCAT ("Réalisateur");
-  return accumulate (cast.begin (), cast.end (), string (), CONCAT);
+  if (data.size () - *offset < sizeof (*n)) return false;
+  memcpy (n, data.data () + *offset, sizeof (*n));
+  *offset += sizeof (*n);
+  return true;
 }
 
-string Freebox::Event::GetCastActors () const
+inline
+bool freebox_read (const string & data, size_t * offset, string * s)
 {
-  static const ConcatIfJob CONCAT ("Acteur");
-  return accumulate (cast.begin (), cast.end (), string (), CONCAT);
+  uint32_t n;
+  if (! freebox_read (data, offset, &n) || data.size () - *offset < n) return false;
+  s->assign (data, *offset, n);
+  *offset += n;
+  return true;
 }
 
-bool Freebox::ProcessChannels ()
+/* static */
+string Freebox::WriteChannels (const Channels & channels)
 {
-  m_tv_channels.clear ();
-
-  Document channels;
-  if (! GET ("/api/v6/tv/channels", &channels)) return false;
+  string data;
+  freebox_write (&data, PVR_FREEBOX_CHANNELS_MAGIC);
+  freebox_write (&data, PVR_FREEBOX_CHANNELS_VERSION);
+  freebox_write (&data, (uint32_t) channels.size ());
+  for (auto & i : channels)
+  {
+    const Channel & c = i.second;
+    freebox_write (&data, c.uuid);
+    freebox_write (&data, c.name);
+    freebox_write (&data, c.logo);
+    freebox_write (&data, (uint32_t) c.major);
+    freebox_write (&data, (uint32_t) c.minor);
+    freebox_write (&data, (uint32_t) c.streams.size ());
+    for (const Stream & s : c.streams)
+    {
+      freebox_write (&data, (uint32_t) s.source);
+      freebox_write (&data, (uint32_t) s.quality);
+      freebox_write (&data, s.url);
+    }
+  }
+  return data;
+}
 
-  char * notification = XBMC->GetLocalizedString (PVR_FREEBOX_STRING_CHANNELS_LOADED);
-  XBMC->QueueNotification (QUEUE_INFO, notification, channels["result"].MemberCount ());
-  XBMC->FreeString (notification);
+/* static */
+bool Freebox::ReadChannels (const string & data, Channels * channels)
+{
+  size_t offset = 0;
+  uint32_t magic, version, n;
+  if (! freebox_read (data, &offset, &magic)   || magic   != PVR_FREEBOX_CHANNELS_MAGIC)   return false;
+  if (! freebox_read (data, &offset, &version) || version != PVR_FREEBOX_CHANNELS_VERSION) return false;
+  if (! freebox_read (data, &offset, &n)) return false;
 
-  //Document bouquets;
-  //GET ("/api/v6/tv/bouquets", &m_tv_bouquets);
+  for (uint32_t i = 0; i < n; ++i)
+  {
+    string uuid, name, logo;
+    uint32_t major, minor, m;
+    if (! freebox_read (data, &offset, &uuid)
+     || ! freebox_read (data, &offset, &name)
+     || ! freebox_read (data, &offset, &logo)
+     || ! freebox_read (data, &offset, &major)
+     || ! freebox_read (data, &offset, &minor)
+     || ! freebox_read (data, &offset, &m)) return false;
+
+    vector<Stream> streams;
+    for (uint32_t j = 0; j < m; ++j)
+    {
+      uint32_t source, quality;
+      string url;
+      if (! freebox_read (data, &offset, &source)
+       || ! freebox_read (data, &offset, &quality)
+       || ! freebox_read (data, &offset, &url)) return false;
+      streams.emplace_back (Source (source), Quality (quality), url);
+    }
 
-  Document bouquet;
-  if (! GET ("/api/v6/tv/bouquets/freeboxtv/channels", &bouquet, kArrayType)) return false;
+    channels->emplace (ChannelId (uuid), Channel (uuid, name, logo, (int) major, (int) minor, streams));
+  }
 
-  // Conflict list.
-  typedef vector<Conflict> Conflicts;
-  // Conflicts by UUID.
-  map<string, Conflicts> conflicts_by_uuid;
-  // Conflicts by major.
-  map<int, Conflicts> conflicts_by_major;
+  return offset == data.size ();
+}
 
-  const Value & r = bouquet ["result"];
-  for (SizeType i = 0; i < r.Size (); ++i)
-  {
-    string uuid  = r[i]["uuid"].GetString ();
-    int    major = r[i]["number"].GetInt ();
-    int    minor = r[i]["sub_number"].GetInt ();
+bool Freebox::LoadChannels ()
+{
+  ifstream ifs (m_path + PVR_FREEBOX_CHANNELS_FILE, ios::binary);
+  string data ((istreambuf_iterator<char> (ifs)), istreambuf_iterator<char> ());
 
-    Conflict c (uuid, major, minor, i);
+  Channels channels;
+  if (! ReadChannels (data, &channels))
+    return false;
 
-    conflicts_by_uuid [uuid] .push_back (c);
-    conflicts_by_major[major].push_back (c);
-  }
+  StoreChannels (move (channels));
+  return true;
+}
 
-  static const ConflictComparator comparator;
+void Freebox::StoreChannels (Channels && channels)
+{
+  ChannelTable table (channels.size ());
+  size_t i = 0;
+  for (auto & c : channels)
+    c.second.GetChannel (&table [i++]);
 
-#if __cplusplus >= 201703L
-  for (auto & [major, v1] : conflicts_by_major)
-#else
-  for (auto & it : conflicts_by_major)
-#endif
-  {
-#if __cplusplus < 201703L
-    int      major = it.first;
-    Conflicts & v1 = it.second;
-#endif
+  m_tv_channels.Store (move (channels));
+  m_tv_table.Store (move (table));
+}
 
-    sort (v1.begin (), v1.end (), comparator);
+void Freebox::LoadPreferences ()
+{
+  PrefsStore::Values values;
 
-    for (size_t j = 1; j < v1.size (); ++j)
+  // No journal yet: former preferences (JSON files) are imported once.
+  if (! m_tv_prefs.Load (&values))
+    for (const char * name : {"source", "quality"})
     {
-      Conflicts & v2 = conflicts_by_uuid [v1[j].uuid];
-      v2.erase (remove_if (v2.begin (), v2.end (),
-        [m = major] (const Conflict & c) {return c.major == m;}));
+      Document d;
+      ifstream ifs (m_path + name + ".txt");
+      IStreamWrapper wrapper (ifs);
+      d.ParseStream (wrapper);
+      if (! d.HasParseError () && d.IsObject ())
+        for (auto i = d.MemberBegin (); i != d.MemberEnd (); ++i)
+          if (i->value.IsString () && i->value.GetStringLength () > 0)
+          {
+            string key = string (name) + ':' + i->name.GetString ();
+            values [key] = i->value.GetString ();
+            m_tv_prefs.Set (key, values [key]);
+          }
     }
 
-    v1.erase (v1.begin () + 1, v1.end ());
+  // "source:uuid-webtv-*", "quality:uuid-webtv-*".
+  map<unsigned int, enum Source>  sources;
+  map<unsigned int, enum Quality> qualities;
+  for (auto & i : values)
+  {
+    size_t colon = i.first.find (':');
+    if (colon == string::npos || i.first.compare (colon + 1, 11, "uuid-webtv-") != 0) continue;
+
+    unsigned int id = strtoul (i.first.c_str () + colon + 12, NULL, 10);
+    if (i.first.compare (0, colon, "source") == 0)
+      sources.emplace (id, ParseSource (i.second));
+    else if (i.first.compare (0, colon, "quality") == 0)
+      qualities.emplace (id, ParseQuality (i.second));
   }
 
-#if __cplusplus >= 201703L
-  for (auto & [uuid, v1] : conflicts_by_uuid)
-#else
-  for (auto & it : conflicts_by_uuid)
-#endif
-  {
-#if __cplusplus < 201703L
-    const string & uuid = it.first;
-    Conflicts    & v1   = it.second;
-#endif
+  m_tv_prefs_source.Store (move (sources));
+  m_tv_prefs_quality.Store (move (qualities));
+}
 
-    if (! v1.empty ())
-    {
-      sort (v1.begin (), v1.end (), comparator);
+bool Freebox::ProcessChannels ()
+{
+  Channels tv_channels;
 
-      for (size_t j = 1; j < v1.size (); ++j)
-      {
-        Conflicts & v2 = conflicts_by_major [v1[j].major];
-        v2.erase (remove_if (v2.begin (), v2.end (),
-          [u = uuid] (const Conflict & c) {return c.uuid == u;}));
-      }
+  Document channels;
+  if (! GET ("/api/v6/tv/channels", &channels)) return false;
 
-      v1.erase (v1.begin () + 1, v1.end ());
-    }
-  }
+  char * notification = XBMC->GetLocalizedString (PVR_FREEBOX_STRING_CHANNELS_LOADED);
+  XBMC->QueueNotification (QUEUE_INFO, notification, channels["result"].MemberCount ());
+  XBMC->FreeString (notification);
 
-#if 0
-  for (auto i : conflicts_by_major)
-    cout << i.first << " : " << StrUUIDs (i.second) << endl;
-#endif
+  //Document bouquets;
+  //GET ("/api/v6/tv/bouquets", &m_tv_bouquets);
 
-#if 0
-  for (auto i = conflicts_by_uuid)
-    cout << i.first << " : " << StrNumbers (i.second) << endl;
-#endif
+  Document bouquet;
+  if (! GET ("/api/v6/tv/bouquets/freeboxtv/channels", &bouquet, kArrayType)) return false;
 
-#if __cplusplus >= 201703L
-  for (auto & [major, q] : conflicts_by_major)
-#else
-  for (auto & it : conflicts_by_major)
-#endif
+  // Numbering conflicts.
+  const Value & r = bouquet ["result"];
+  Bouquet numbers (r.Size ());
+  for (SizeType i = 0; i < r.Size (); ++i)
   {
-#if __cplusplus < 201703L
-    int           major = it.first;
-    const Conflicts & q = it.second;
-#endif
+    const Value & uuid = r[i]["uuid"];
+    numbers.Add (string_view (uuid.GetString (), uuid.GetStringLength ()),
+                 r[i]["number"].GetInt (), r[i]["sub_number"].GetInt (), i);
+  }
 
-    if (! q.empty ())
+  for (const Bouquet::Entry & ch : numbers.Resolve ())
+  {
+    string uuid (ch.uuid);
+    const Value  & channel = channels["result"][uuid];
+    const string & name    = channel["name"].GetString ();
+    const string & logo    = URL (channel["logo_url"].GetString ());
+    const Value  & item    = r[ch.position];
+
+    vector<Stream> data;
+    if (item.HasMember("available") && item["available"].GetBool ()
+     && item.HasMember("streams")   && item["streams"].IsArray ())
     {
-      const Conflict & ch = q.front ();
-      const Value  & channel = channels["result"][ch.uuid];
-      const string & name    = channel["name"].GetString ();
-      const string & logo    = URL (channel["logo_url"].GetString ());
-      const Value  & item    = bouquet["result"][ch.position];
-
-      vector<Stream> data;
-      if (item.HasMember("available") && item["available"].GetBool ()
-       && item.HasMember("streams")   && item["streams"].IsArray ())
+      const Value & streams = item["streams"];
+      for (SizeType i = 0; i < streams.Size (); ++i)
       {
-        const Value & streams = item["streams"];
-        for (SizeType i = 0; i < streams.Size (); ++i)
-        {
-          const Value  & s = streams [i];
-          const string & t = s["type"].GetString ();
-          const string & q = s["quality"].GetString ();
-          const string & r = s["rtsp"].GetString ();
-          data.emplace_back (ParseSource (t), ParseQuality (q), r);
-        }
+        const Value  & s = streams [i];
+        const string & t = s["type"].GetString ();
+        const string & q = s["quality"].GetString ();
+        const string & r = s["rtsp"].GetString ();
+        data.emplace_back (ParseSource (t), ParseQuality (q), r);
       }
-      m_tv_channels.emplace (ChannelId (ch.uuid), Channel (ch.uuid, name, logo, ch.major, ch.minor, data));
     }
+    tv_channels.emplace (ChannelId (uuid), Channel (uuid, name, logo, ch.major, ch.minor, data));
   }
 
-  {
-    Document d;
-    ifstream ifs (m_path + "source.txt");
-    IStreamWrapper wrapper (ifs);
-    d.ParseStream (wrapper);
-    if (! d.HasParseError () && d.IsObject ())
-      for (auto i = d.MemberBegin (); i != d.MemberEnd (); ++i)
-        m_tv_prefs_source.emplace (ChannelId (i->name.GetString ()), ParseSource (i->value.GetString ()));
-  }
+  // Unchanged since last snapshot?
+  string snapshot = WriteChannels (tv_channels);
+  if (snapshot == WriteChannels (*m_tv_channels.Load ()))
+    return true;
+
+  StoreChannels (move (tv_channels));
 
+  // Replaced atomically: a crash while writing keeps the old snapshot.
+  string file = m_path + PVR_FREEBOX_CHANNELS_FILE, tmp = file + ".tmp";
+  bool written;
   {
-    Document d;
-    ifstream ifs (m_path + "quality.txt");
-    IStreamWrapper wrapper (ifs);
-    d.ParseStream (wrapper);
-    if (! d.HasParseError () && d.IsObject ())
-      for (auto i = d.MemberBegin (); i != d.MemberEnd (); ++i)
-        m_tv_prefs_quality.emplace (ChannelId (i->name.GetString ()), ParseQuality (i->value.GetString ()));
+    ofstream ofs (tmp, ios::binary | ios::trunc);
+    ofs.write (snapshot.data (), snapshot.size ());
+    ofs.close ();
+    written = ! ofs.fail ();
   }
+#ifdef TARGET_WINDOWS
+  if (! written || ! MoveFileExA (tmp.c_str (), file.c_str (), MOVEFILE_REPLACE_EXISTING))
+#else
+  if (! written || rename (tmp.c_str (), file.c_str ()) != 0)
+#endif
+    remove (tmp.c_str ());
 
+  PVR->TriggerChannelUpdate ();
   return true;
 }
 
@@ -880,24 +1193,43 @@ Freebox::Freebox (const string & path,
                   int quality,
                   int days,
                   bool extended,
+                  int window,
+                  int budget,
                   bool colors,
-                  int delay) :
+                  int delay,
+                  int connections,
+                  int keepalive,
+                  int workers) :
   m_path (path),
   m_server ("mafreebox.freebox.fr"),
+  m_http (m_server, 80, connections, keepalive),
+  m_limiter (PVR_FREEBOX_HTTP_RATE, 1.0 / max (delay, 1), PVR_FREEBOX_HTTP_MAX, PVR_FREEBOX_HTTP_BURST),
   m_delay (delay),
   m_app_token (),
   m_track_id (),
   m_session_token (),
   m_tv_channels (),
+  m_tv_table (),
   m_tv_source (Source (source)),
   m_tv_quality (Quality (quality)),
   m_tv_prefs_source (),
   m_tv_prefs_quality (),
+  m_tv_prefs (path + PVR_FREEBOX_PREFS_FILE),
+  m_tv_health (path + PVR_FREEBOX_HEALTH_FILE),
   m_epg_queries (),
-  m_epg_cache (),
+  m_epg_requested (),
+  m_epg_event (),
+  m_epg_workers (),
+  m_epg_busy (0),
+  m_epg_slots (),
+  m_epg_store (path + PVR_FREEBOX_EPG_FILE),
   m_epg_days (0),
-  m_epg_last (0),
   m_epg_extended (extended),
+  m_epg_window (window),
+  m_epg_budget (budget),
+  m_epg_horizon (0),
+  m_epg_details (PVR_FREEBOX_EPG_DETAILS),
+  m_epg_fetching (),
   m_epg_colors (colors),
   m_recordings (),
   m_unique_id (1),
@@ -906,13 +1238,52 @@ Freebox::Freebox (const string & path,
 {
   XBMC->QueueNotification (QUEUE_INFO, PVR_FREEBOX_VERSION);
   SetDays (days);
-  ProcessChannels ();
-  CreateThread ();
+  // Last known channels: the Freebox Server is queried later, in Process ().
+  LoadPreferences ();
+  m_tv_prefs.CreateThread ();
+  LoadChannels ();
+  m_tv_health.Load ();
+  m_epg_store.Load ();
+
+  for (int i = 0; i < max (workers, 1); ++i)
+    m_epg_workers.emplace_back (new Worker (this));
 }
 
 Freebox::~Freebox ()
 {
+  Stop ();
+
+  m_tv_health.Save ();
+  m_epg_store.Save (time (NULL));
+}
+
+// Not from the constructor: threads must see the final object (virtual HTTP).
+void Freebox::Start ()
+{
+  CreateThread ();
+
+  for (auto & w : m_epg_workers)
+    w->CreateThread ();
+}
+
+// Before the destructor of a derived class, for the same reason.
+void Freebox::Stop ()
+{
+  if (! IsRunning ()) return;
+
+  for (auto & w : m_epg_workers)
+    w->StopThread (-1);
+
+  m_epg_event.Broadcast ();
+  m_limiter.Abort ();
+
+  for (auto & w : m_epg_workers)
+    w->StopThread ();
+
   StopThread ();
+
+  // Nobody else is querying: the logout goes through.
+  m_limiter.Resume ();
   CloseSession ();
 }
 
@@ -930,26 +1301,36 @@ string Freebox::URL (const string & query) const
 
 void Freebox::SetSource (int s)
 {
-  P8PLATFORM::CLockObject lock (m_mutex);
   m_tv_source = Source (s);
 }
 
 void Freebox::SetQuality (int q)
+{
+  m_tv_quality = Quality (q);
+}
+
+void Freebox::SetDays (int d)
+{
+  P8PLATFORM::CLockObject lock (m_mutex);
+  m_epg_days = d != EPG_TIMEFRAME_UNLIMITED ? min (d, 7) : 7;
+}
+
+void Freebox::SetExtended (bool e)
 {
   P8PLATFORM::CLockObject lock (m_mutex);
-  m_tv_quality = Quality (q);
+  m_epg_extended = e;
 }
 
-void Freebox::SetDays (int d)
+void Freebox::SetWindow (int w)
 {
   P8PLATFORM::CLockObject lock (m_mutex);
-  m_epg_days = d != EPG_TIMEFRAME_UNLIMITED ? min (d, 7) : 7;
+  m_epg_window = w;
 }
 
-void Freebox::SetExtended (bool e)
+void Freebox::SetBudget (int b)
 {
   P8PLATFORM::CLockObject lock (m_mutex);
-  m_epg_extended = e;
+  m_epg_budget = b;
 }
 
 void Freebox::SetColors (bool c)
@@ -962,45 +1343,46 @@ void Freebox::SetDelay (int d)
 {
   P8PLATFORM::CLockObject lock (m_mutex);
   m_delay = d;
+  m_limiter.SetMinimum (1.0 / max (d, 1));
 }
 
-void Freebox::ProcessEvent (const Event & e, EPG_EVENT_STATE state)
+void Freebox::SetConnections (int c)
 {
-  // FIXME: SHOULDN'T HAPPEN!
-  if (e.uuid.find ("pluri_") != 0)
-  {
-#if 1
-  cout << e.uuid << " : " << '"' << e.title << '"' << ' ' << e.date << '+' << e.duration << " (" << e.channel << ')' << endl;
-  cout << "  " << e.category << ' ' << e.season << 'x' << e.episode << ' ' << '"' << e.subtitle << '"' << ' ' << '[' << e.picture << ']' << endl;
-  cout << "  " << '"' << e.outline << '"' << endl;
-  cout << "  " << '"' << e.plot << '"' << endl;
-#endif
+  m_http.SetSize (c);
+}
 
-    XBMC->Log (LOG_ERROR, "%s : \"%s\" %d+%d", e.uuid.c_str (), e.title.c_str (), e.date, e.duration);
-    return;
-  }
+void Freebox::SetKeepAlive (int k)
+{
+  m_http.SetIdle (k);
+}
+
+void Freebox::TransferEntry (const EPGStore::View & e, const function<void (EPG_TAG *)> & transfer)
+{
+  // Per-thread scratch buffer.
+  thread_local string picture;
 
   m_mutex.Lock ();
   bool colors = m_epg_colors;
-  string picture = ! e.picture.empty () ? URL (e.picture) : "";
+  picture.clear ();
+  if (! e.picture.empty ())
+    picture.append ("http://").append (m_server).append (e.picture);
   m_mutex.Unlock ();
 
-  string actors   = e.GetCastActors   ();
-  string director = e.GetCastDirector ();
+  const char * genre = colors ? "" : Event::Native (e.category);
 
   EPG_TAG tag;
   memset (&tag, 0, sizeof (EPG_TAG));
 
-  tag.iUniqueBroadcastId  = BroadcastId (e.uuid);
+  tag.iUniqueBroadcastId  = e.broadcast;
   tag.strTitle            = PVR_FREEBOX_C_STR (e.title);
   tag.iUniqueChannelId    = e.channel;
-  tag.startTime           = e.date;
-  tag.endTime             = e.date + e.duration;
+  tag.startTime           = e.start;
+  tag.endTime             = e.start + e.duration;
   tag.strPlotOutline      = PVR_FREEBOX_C_STR (e.outline);
   tag.strPlot             = PVR_FREEBOX_C_STR (e.plot);
   tag.strOriginalTitle    = NULL;
-  tag.strCast             = PVR_FREEBOX_C_STR (actors);
-  tag.strDirector         = PVR_FREEBOX_C_STR (director);
+  tag.strCast             = PVR_FREEBOX_C_STR (e.actors);
+  tag.strDirector         = PVR_FREEBOX_C_STR (e.director);
   tag.strWriter           = NULL;
   tag.iYear               = e.year;
   tag.strIMDBNumber       = NULL;
@@ -1014,10 +1396,9 @@ void Freebox::ProcessEvent (const Event & e, EPG_EVENT_STATE state)
   }
   else
   {
-    string c = Event::Native (e.category);
     tag.iGenreType          = EPG_GENRE_USE_STRING;
     tag.iGenreSubType       = 0;
-    tag.strGenreDescription = PVR_FREEBOX_C_STR (c);
+    tag.strGenreDescription = *genre ? genre : NULL;
   }
   tag.iParentalRating     = 0;
   tag.iStarRating         = 0;
@@ -1027,71 +1408,319 @@ void Freebox::ProcessEvent (const Event & e, EPG_EVENT_STATE state)
   tag.strEpisodeName      = PVR_FREEBOX_C_STR (e.subtitle);
   tag.iFlags              = EPG_TAG_FLAG_UNDEFINED;
 
-  PVR->EpgEventStateChange (&tag, state);
+  transfer (&tag);
 }
 
-void Freebox::ProcessEvent (const Value & event, unsigned int channel, time_t date, EPG_EVENT_STATE state)
+/* static */
+EPGStore::View Freebox::ParseEvent (const Value & event, unsigned int channel, time_t date, bool extended)
+{
+  string_view uuid = freebox_view (event, "id");
+
+  // Per-thread scratch buffers.
+  thread_local string actors;
+  thread_local string director;
+  freebox_cast (event, &actors, &director);
+
+  EPGStore::View e;
+  e.broadcast = BroadcastId (uuid.data ());
+  e.channel   = channel;
+  e.start     = JSON<int> (event, "date", date);
+  e.duration  = JSON<int> (event, "duration");
+  e.category  = JSON<int> (event, "category");
+  e.season    = JSON<int> (event, "season_number");
+  e.episode   = JSON<int> (event, "episode_number");
+  e.year      = JSON<int> (event, "year");
+  e.extended  = extended;
+  e.title     = freebox_view (event, "title");
+  e.subtitle  = freebox_view (event, "sub_title");
+  e.outline   = freebox_view (event, "short_desc");
+  e.plot      = freebox_view (event, "desc");
+  e.picture   = freebox_view (event, "picture_big", freebox_view (event, "picture"));
+  e.actors    = actors;
+  e.director  = director;
+  // Details keep the fingerprint of the listing.
+  e.fingerprint = extended ? 0 : EPGStore::Hash (e.title, e.subtitle, e.start, e.duration);
+  return e;
+}
+
+void Freebox::ProcessEvent (const Value & event, unsigned int channel, time_t date, EPG_EVENT_STATE state, bool extended)
 {
+  {
+    auto channels = m_tv_channels.Load ();
+    auto f = channels->find (channel);
+    if (f == channels->end () || f->second.IsHidden ()) return;
+  }
+
+  string_view uuid = freebox_view (event, "id");
+
+  // FIXME: SHOULDN'T HAPPEN!
+  if (uuid.compare (0, 6, "pluri_") != 0)
+  {
+    string_view title = freebox_view (event, "title");
+    XBMC->Log (LOG_ERROR, "%.*s : \"%.*s\" %d", (int) uuid.size (), uuid.data (), (int) title.size (), title.data (), JSON<int> (event, "date", date));
+    return;
+  }
+
+  EPGStore::View e = ParseEvent (event, channel, date, extended);
+
+  EPGStore::Entry cached;
+  bool rescheduled = false;
   {
     P8PLATFORM::CLockObject lock (m_mutex);
-    auto f = m_tv_channels.find (channel);
-    if (f == m_tv_channels.end () || f->second.IsHidden ()) return;
+    if (extended)
+      m_epg_details.Put (e);
+    else if (m_epg_details.Get (e.broadcast, &cached))
+    {
+      // Same program, new schedule: the cached details still apply.
+      rescheduled = cached.title == e.title && cached.subtitle == e.subtitle;
+      if (rescheduled)
+      {
+        cached.channel     = channel;
+        cached.start       = e.start;
+        cached.duration    = e.duration;
+        cached.fingerprint = e.fingerprint;
+        m_epg_details.Put (cached);
+      }
+      else
+        m_epg_details.Erase (e.broadcast); // outdated
+    }
   }
 
-  Event e (event, channel, date);
+  if (rescheduled)
+  {
+    m_epg_store.Add (cached);
+    TransferEntry (cached, [state] (EPG_TAG * tag) {PVR->EpgEventStateChange (tag, state);});
+    return;
+  }
+
+  m_epg_store.Add (e);
+  TransferEntry (e, [state] (EPG_TAG * tag) {PVR->EpgEventStateChange (tag, state);});
+
+  if (! extended)
+  {
+    // Extended details: only fetched in the near future (see Process ()).
+    m_mutex.Lock ();
+    time_t now    = time (NULL);
+    bool   window = e.start < now + m_epg_window * 3600 && e.start + e.duration > now;
+    m_mutex.Unlock ();
 
-  if (state == EPG_EVENT_CREATED)
+    RequestDetails (e.broadcast, channel, e.start, Scheduler::EXTENDED, window);
+  }
+}
+
+void Freebox::RequestDetails (unsigned int broadcast, unsigned int channel, time_t date, Scheduler::Class c, bool fetch)
+{
+  EPGStore::Entry e;
   {
     P8PLATFORM::CLockObject lock (m_mutex);
-    if (m_epg_extended)
+    if (! m_epg_extended) return;
+
+    if (! m_epg_details.Get (broadcast, &e))
     {
-      string query = "/api/v6/tv/epg/programs/" + e.uuid;
-      m_epg_queries.emplace (EVENT, query, channel, date);
+      if (fetch && m_epg_fetching.Insert (broadcast))
+      {
+        string query = "/api/v6/tv/epg/programs/pluri_" + to_string (broadcast);
+        m_epg_queries.Push (c, Query (EVENT, query, channel, date));
+        m_epg_event.Signal ();
+      }
+      return;
     }
   }
 
-  ProcessEvent (e, state);
+  // Cached details, current schedule.
+  e.channel = channel;
+  e.start   = date;
+  m_epg_store.Add (e);
+  TransferEntry (e, [] (EPG_TAG * tag) {PVR->EpgEventStateChange (tag, EPG_EVENT_UPDATED);});
+}
+
+void Freebox::RequestDetails (unsigned int broadcast)
+{
+  EPGStore::Entry stored;
+  if (! m_epg_store.Find (broadcast, &stored) || stored.extended) return;
+
+  RequestDetails (broadcast, stored.channel, stored.start, Scheduler::CHANNEL, true);
 }
 
-void Freebox::ProcessChannel (const Value & epg, unsigned int channel)
+void Freebox::ProcessEntry (const Value & event, unsigned int channel)
 {
-  for (auto i = epg.MemberBegin (); i != epg.MemberEnd (); ++i)
+  string_view uuid = freebox_view (event, "id");
+  time_t      date = JSON<int> (event, "date");
+
+  if (uuid.compare (0, 6, "pluri_") != 0) return;
+
+  unsigned int broadcast = BroadcastId (uuid.data ());
+
+  // Several workers may stumble upon the same event (overlapping slices).
   {
-    const Value & event = i->value;
+    P8PLATFORM::CLockObject lock (m_mutex);
+    if (! m_epg_slots [date - date % 3600].events.Insert (broadcast)) return;
+  }
 
-    string uuid = JSON<string> (event, "id");
-    time_t date = JSON<int>    (event, "date");
+  uint32_t fingerprint = EPGStore::Hash (freebox_view (event, "title"), freebox_view (event, "sub_title"),
+                                         date, JSON<int> (event, "duration"));
 
-    static const string PREFIX = "pluri_";
-    if (uuid.find (PREFIX) != 0) continue;
+  // Already known (from a previous run, maybe), and unchanged.
+  // Missing extended details are requested by Process () when needed.
+  uint32_t known = m_epg_store.Fingerprint (broadcast);
+  if (known == fingerprint) return;
 
-    string query = "/api/v6/tv/epg/programs/" + uuid;
+  ProcessEvent (event, channel, date, known != 0 ? EPG_EVENT_UPDATED : EPG_EVENT_CREATED, false);
+}
+
+void Freebox::PurgeSlot (time_t slot)
+{
+  vector<EPGStore::Entry> gone;
+  m_epg_store.FindStarting (slot, slot + 3600, false, [this, slot, &gone] (const EPGStore::Entry & e)
+  {
+    P8PLATFORM::CLockObject lock (m_mutex);
+    auto f = m_epg_slots.find (slot);
+    if (f != m_epg_slots.end () && ! f->second.events.Contains (e.broadcast))
+      gone.push_back (e);
+  });
 
+  for (const EPGStore::Entry & e : gone)
+  {
+    // Rescheduled (or removed) meanwhile by another worker: not ours anymore.
+    if (! m_epg_store.RemoveIf (e.broadcast, slot, slot + 3600)) continue;
     {
       P8PLATFORM::CLockObject lock (m_mutex);
-      if (m_epg_cache.count (query) > 0) continue;
+      m_epg_details.Erase (e.broadcast);
     }
+    TransferEntry (e, [] (EPG_TAG * tag) {PVR->EpgEventStateChange (tag, EPG_EVENT_DELETED);});
+  }
+}
 
-    ProcessEvent (event, channel, date, EPG_EVENT_CREATED);
+void Freebox::ProcessQuery (const Query & q)
+{
+  //cout << q.query << endl;
+  XBMC->Log (LOG_INFO, "Processing: '%s'", q.query.c_str ());
 
+  // Events are processed as soon as they are received.
+  switch (q.type)
+  {
+    case FULL :
     {
+      bool success = GET (q.query, 2, [this] (const Keys & k, const Value & e) {ProcessEntry (e, ChannelId (k[0]));});
+      // Failed slices will be queued again.
+      if (success)
+      {
+        m_epg_store.SetSlice (q.date, time (NULL));
+        PurgeSlot (q.date);
+      }
       P8PLATFORM::CLockObject lock (m_mutex);
-      m_epg_cache.insert (query);
+      m_epg_slots [q.date].pending = false;
+      break;
     }
+
+    case CHANNEL :
+      GET (q.query, 1, [this, &q] (const Keys &, const Value & e) {ProcessEntry (e, q.channel);});
+      break;
+
+    case EVENT :
+      GET (q.query, 0, [this, &q] (const Keys &, const Value & e) {ProcessEvent (e, q.channel, q.date, EPG_EVENT_UPDATED, true);});
+      break;
+
+    default:
+      break;
   }
 }
 
-void Freebox::ProcessFull (const Value & epg)
+void Freebox::Scheduler::Push (Class c, const Query & q)
+{
+  m_queues [c].emplace_back (P8PLATFORM::GetTimeMs (), q);
+}
+
+bool Freebox::Scheduler::Pop (Query * q)
+{
+  int64_t now  = P8PLATFORM::GetTimeMs ();
+  int     best = -1;
+  int64_t rank = 0;
+
+  // Oldest query of each class, promoted as it waits.
+  for (int c = 0; c < CLASSES; ++c)
+    if (! m_queues [c].empty ())
+    {
+      int64_t r = c * AGING - (now - m_queues [c].front ().first);
+      if (best < 0 || r < rank)
+      {
+        best = c;
+        rank = r;
+      }
+    }
+
+  if (best < 0) return false;
+
+  *q = m_queues [best].front ().second;
+  m_queues [best].pop_front ();
+  return true;
+}
+
+bool Freebox::Scheduler::Empty () const
+{
+  for (int c = 0; c < CLASSES; ++c)
+    if (! m_queues [c].empty ()) return false;
+  return true;
+}
+
+size_t Freebox::Scheduler::Size (Class c) const
+{
+  return m_queues [c].size ();
+}
+
+void Freebox::RequestChannel (unsigned int id, time_t slot)
+{
+  P8PLATFORM::CLockObject lock (m_mutex);
+  if (! m_epg_requested.emplace (id, slot).second) return;
+
+  string query = "/api/v6/tv/epg/by_channel/uuid-webtv-" + to_string (id) + '/' + to_string (slot);
+  m_epg_queries.Push (Scheduler::CHANNEL, Query (CHANNEL, query, id, slot));
+  m_epg_event.Signal ();
+}
+
+bool Freebox::PopQuery (Query * q)
+{
+  P8PLATFORM::CLockObject lock (m_mutex);
+  if (! m_epg_queries.Pop (q)) return false;
+  ++m_epg_busy;
+  return true;
+}
+
+void Freebox::DoneQuery ()
+{
+  P8PLATFORM::CLockObject lock (m_mutex);
+  --m_epg_busy;
+}
+
+Freebox::Worker::Worker (Freebox * freebox) :
+  m_freebox (freebox)
+{
+}
+
+void * Freebox::Worker::Process ()
 {
-  for (auto i = epg.MemberBegin (); i != epg.MemberEnd (); ++i)
+  while (! IsStopped ())
   {
-    string uuid = i->name.GetString ();
-    ProcessChannel (i->value, ChannelId (uuid));
+    Query q;
+    if (! m_freebox->PopQuery (&q))
+    {
+      m_freebox->m_epg_event.Wait (1000);
+      continue;
+    }
+
+    // Throttled by the (global) rate limiter.
+    m_freebox->ProcessQuery (q);
+
+    m_freebox->DoneQuery ();
   }
+
+  return NULL;
 }
 
 void * Freebox::Process ()
 {
+  bool channels = false;
+
   while (! IsStopped ())
   {
     m_mutex.Lock ();
@@ -1099,92 +1728,175 @@ void * Freebox::Process ()
     int    days  = m_epg_days;
     time_t now   = time (NULL);
     time_t end   = now + days * 24 * 60 * 60;
-    time_t last  = max (now, m_epg_last);
+    time_t first = now - now % 3600;
+    bool   extended = m_epg_extended;
+    time_t window   = m_epg_window * 3600;
+    size_t budget   = (size_t) m_epg_budget << 20;
     m_mutex.Unlock ();
 
+    if (! channels)
+      channels = ProcessChannels ();
+
     if (StartSession ())
     {
-      P8PLATFORM::CLockObject lock (m_mutex);
       ProcessGenerators ();
       ProcessTimers ();
       ProcessRecordings ();
     }
 
-    for (time_t t = last - (last % 3600); t < end; t += 3600)
-    {
-      string epoch = to_string (t);
-      string query = "/api/v6/tv/epg/by_time/" + epoch;
+    // Extended details, for programs on air or starting soon.
+    if (extended)
+      m_epg_store.FindStarting (first - 6 * 3600, now + window, true, [this, now] (const EPGStore::Entry & e)
       {
-        P8PLATFORM::CLockObject lock (m_mutex);
-        m_epg_queries.emplace (FULL, query);
-        //XBMC->Log (LOG_INFO, "Queued: '%s' %d < %d", query.c_str (), t, end);
-        m_epg_last = t + 3600;
-      }
-    }
+        if (e.start + e.duration > now)
+          RequestDetails (e.broadcast, e.channel, e.start, Scheduler::EXTENDED, true);
+      });
 
-    Query q;
+    // Memory budget: evicted slots are fetched again once there is room.
+    time_t drop = budget > 0 ? m_epg_store.Trim (budget, now, first + PVR_FREEBOX_EPG_FAR) : 0;
+    size_t used = m_epg_store.GetStats ().bytes;
+
+    bool idle = false;
     {
       P8PLATFORM::CLockObject lock (m_mutex);
-      if (! m_epg_queries.empty ())
+
+      if (budget == 0)
+        m_epg_horizon = 0;
+      else if (drop != 0)
+        m_epg_horizon = m_epg_horizon != 0 ? min (m_epg_horizon, drop) : drop;
+      else if (m_epg_horizon != 0 && used < budget / 4 * 3)
+        m_epg_horizon += 3600;
+
+      if (m_epg_horizon >= end)
+        m_epg_horizon = 0;
+      else if (m_epg_horizon != 0)
+        end = m_epg_horizon;
+
+      // Past slots.
+      m_epg_slots.erase (m_epg_slots.begin (), m_epg_slots.lower_bound (first));
+      for (auto i = m_epg_requested.begin (); i != m_epg_requested.end ();)
+        if (i->second < first)
+          i = m_epg_requested.erase (i);
+        else
+          ++i;
+
+      // Stale slots (or missing from the EPG store) get a new generation.
+      for (time_t t = first; t < end; t += 3600)
       {
-        q = m_epg_queries.front ();
-        m_epg_queries.pop ();
+        Slot & slot = m_epg_slots [t];
+        if (slot.pending) continue;
+
+        time_t ttl = t < now + PVR_FREEBOX_EPG_NEAR ? PVR_FREEBOX_EPG_TTL_NEAR : PVR_FREEBOX_EPG_TTL_FAR;
+        if (now - m_epg_store.Fetched (t) < ttl) continue;
+
+        slot.generation += 1;
+        slot.pending     = true;
+        slot.events.Clear ();
+
+        string epoch = to_string (t);
+        string query = "/api/v6/tv/epg/by_time/" + epoch;
+        Scheduler::Class c = t < now + 2 * 3600        ? Scheduler::NOW   :
+                             t < now + 24 * 60 * 60    ? Scheduler::TODAY :
+                                                         Scheduler::LATER;
+        m_epg_queries.Push (c, Query (FULL, query, 0, t));
+        //XBMC->Log (LOG_INFO, "Queued: '%s' (generation %d)", query.c_str (), slot.generation);
       }
-    }
-
-    if (q.type != NONE)
-    {
-      //cout << q.query << " [" << delay << ']' << endl;
-      XBMC->Log (LOG_INFO, "Processing: '%s'", q.query.c_str ());
 
-      Document json;
-      if (GET (q.query, &json))
+      if (! m_epg_queries.Empty ())
+        m_epg_event.Broadcast ();
+      else if (m_epg_busy == 0)
       {
-        switch (q.type)
-        {
-          case FULL    : ProcessFull    (json["result"]); break;
-          case CHANNEL : ProcessChannel (json["result"], q.channel); break;
-          case EVENT   : ProcessEvent   (json["result"], q.channel, q.date, EPG_EVENT_UPDATED); break;
-          default      : break;
-        }
+        // Failed EVENT queries may be queued again.
+        m_epg_fetching.Clear ();
+        idle = true;
       }
     }
-    else
+
+    // Nothing left to fetch: time to persist the EPG.
+    if (idle)
     {
-      P8PLATFORM::CLockObject lock (m_mutex);
-      m_epg_cache.clear ();
+      m_tv_health.Save ();
+      m_epg_store.Save (now);
     }
 
+    m_mutex.Lock ();
+    XBMC->Log (LOG_DEBUG, "EPG: %d/%d/%d/%d/%d queries (now/today/channel/extended/far), %d running",
+               (int) m_epg_queries.Size (Scheduler::NOW),
+               (int) m_epg_queries.Size (Scheduler::TODAY),
+               (int) m_epg_queries.Size (Scheduler::CHANNEL),
+               (int) m_epg_queries.Size (Scheduler::EXTENDED),
+               (int) m_epg_queries.Size (Scheduler::LATER),
+               m_epg_busy);
+    m_mutex.Unlock ();
+
+    EPGStore::Stats stats = m_epg_store.GetStats ();
+    XBMC->Log (LOG_DEBUG, "EPG: %d events (%d records, %d strings), %d bytes (%d per event, %d peak)",
+               (int) stats.events, (int) stats.records, (int) stats.strings, (int) stats.bytes,
+               (int) (stats.bytes / max<size_t> (stats.events, 1)), (int) stats.peak);
+
+    uint64_t wire, decoded;
+    m_http.Statistics (&wire, &decoded);
+    XBMC->Log (LOG_DEBUG, "HTTP: %.2f queries/s, %llu bytes received (%llu decoded)",
+               m_limiter.Rate (), (unsigned long long) wire, (unsigned long long) decoded);
+
     Sleep (delay * 1000);
   }
 
   return NULL;
 }
 
+PVR_ERROR Freebox::GetEPGForChannel (ADDON_HANDLE handle, int id, time_t start, time_t end)
+{
+  m_epg_store.Find (id, start, end, [this, handle] (const EPGStore::Entry & e)
+  {
+    TransferEntry (e, [handle] (EPG_TAG * tag) {PVR->TransferEpgEntry (handle, tag);});
+  });
+
+  m_mutex.Lock ();
+  time_t now     = time (NULL);
+  time_t horizon = now + m_epg_days * 24 * 60 * 60;
+  if (m_epg_horizon != 0) horizon = min (horizon, m_epg_horizon);
+  m_mutex.Unlock ();
+
+  // Missing range: the first slot neither fetched nor queued is requested.
+  time_t from = max (start, now);
+  for (time_t t = from - from % 3600; t < min (end, horizon); t += 3600)
+    if (m_epg_store.Fetched (t) == 0)
+    {
+      m_mutex.Lock ();
+      auto f = m_epg_slots.find (t);
+      bool pending = f != m_epg_slots.end () && f->second.pending;
+      m_mutex.Unlock ();
+
+      if (! pending) RequestChannel (id, t);
+      break;
+    }
+
+  return PVR_ERROR_NO_ERROR;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // C H A N N E L S /////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 
 int Freebox::GetChannelsAmount ()
 {
-  P8PLATFORM::CLockObject lock (m_mutex);
-  return m_tv_channels.size ();
+  return m_tv_table.Load ()->size ();
 }
 
 PVR_ERROR Freebox::GetChannels (ADDON_HANDLE handle, bool radio)
 {
-  P8PLATFORM::CLockObject lock (m_mutex);
+  if (radio) return PVR_ERROR_NO_ERROR;
 
-  //for (auto i = m_tv_channels.begin (); i != m_tv_channels.end (); ++i)
-  for (auto i : m_tv_channels)
-    i.second.GetChannel (handle, radio);
+  auto table = m_tv_table.Load ();
+  for (const PVR_CHANNEL & c : *table)
+    PVR->TransferChannelEntry (handle, &c);
 
   return PVR_ERROR_NO_ERROR;
 }
 
 int Freebox::GetChannelGroupsAmount ()
 {
-  P8PLATFORM::CLockObject lock (m_mutex);
   return 0;
 }
 
@@ -1206,72 +1918,89 @@ PVR_ERROR Freebox::GetChannelStreamProperties (const PVR_CHANNEL * channel, PVR_
   enum Source  source  = ChannelSource  (channel->iUniqueId, true);
   enum Quality quality = ChannelQuality (channel->iUniqueId, true);
 
-  P8PLATFORM::CLockObject lock (m_mutex);
-  auto f = m_tv_channels.find (channel->iUniqueId);
-  if (f != m_tv_channels.end ())
-    return f->second.GetStreamProperties (source, quality, properties, count);
+  // Cold start: this channel can't wait for the current slot.
+  time_t now  = time (NULL);
+  time_t slot = now - now % 3600;
+  if (m_epg_store.Fetched (slot) == 0)
+    RequestChannel (channel->iUniqueId, slot);
+
+  auto channels = m_tv_channels.Load ();
+  auto f = channels->find (channel->iUniqueId);
+  if (f != channels->end ())
+    return f->second.GetStreamProperties (source, quality, m_tv_health, properties, count);
 
   return PVR_ERROR_NO_ERROR;
 }
 
+void Freebox::StreamStarted ()
+{
+  m_tv_health.Playing ();
+}
+
 enum Freebox::Source Freebox::ChannelSource (unsigned int id, bool fallback)
 {
-  P8PLATFORM::CLockObject lock (m_mutex);
-  auto f = m_tv_prefs_source.find (id);
-  return f != m_tv_prefs_source.end () ? f->second : (fallback ? m_tv_source : Source::DEFAULT);
+  auto prefs = m_tv_prefs_source.Load ();
+  auto f = prefs->find (id);
+  return f != prefs->end () ? f->second : (fallback ? m_tv_source.load () : Source::DEFAULT);
 }
 
 void Freebox::SetChannelSource (unsigned int id, enum Source source)
 {
-  P8PLATFORM::CLockObject lock (m_mutex);
-  switch (source)
+  string value;
   {
-    case Source::AUTO : m_tv_prefs_source.erase (id); break;
-    case Source::IPTV : m_tv_prefs_source [id] = Source::IPTV; break;
-    case Source::DVB  : m_tv_prefs_source [id] = Source::DVB;  break;
-    default           : break;
-  }
+    P8PLATFORM::CLockObject lock (m_mutex);
+    m_tv_prefs_source.Update ([id, source] (map<unsigned int, enum Source> & prefs)
+    {
+      switch (source)
+      {
+        case Source::AUTO : prefs.erase (id); break;
+        case Source::IPTV : prefs [id] = Source::IPTV; break;
+        case Source::DVB  : prefs [id] = Source::DVB;  break;
+        default           : break;
+      }
+    });
 
-  Document d (kObjectType);
-  auto & a = d.GetAllocator ();
-  for (auto & i : m_tv_prefs_source)
-    d.AddMember (Value ("uuid-webtv-" + to_string (i.first), a), Value (StrSource (i.second), a), a);
+    auto prefs = m_tv_prefs_source.Load ();
+    auto f = prefs->find (id);
+    value = f != prefs->end () ? StrSource (f->second) : "";
+  }
 
-  ofstream ofs (m_path + "source.txt");
-  OStreamWrapper wrapper (ofs);
-  Writer<OStreamWrapper> writer (wrapper);
-  d.Accept (writer);
+  // Written behind (empty = erased).
+  m_tv_prefs.Set ("source:uuid-webtv-" + to_string (id), value);
 }
 
 enum Freebox::Quality Freebox::ChannelQuality (unsigned int id, bool fallback)
 {
-  P8PLATFORM::CLockObject lock (m_mutex);
-  auto f = m_tv_prefs_quality.find (id);
-  return f != m_tv_prefs_quality.end () ? f->second : (fallback ? m_tv_quality : Quality::DEFAULT);
+  auto prefs = m_tv_prefs_quality.Load ();
+  auto f = prefs->find (id);
+  return f != prefs->end () ? f->second : (fallback ? m_tv_quality.load () : Quality::DEFAULT);
 }
 
 void Freebox::SetChannelQuality (unsigned int id, enum Quality quality)
 {
-  P8PLATFORM::CLockObject lock (m_mutex);
-  switch (quality)
+  string value;
   {
-    case Quality::AUTO   : m_tv_prefs_quality.erase (id); break;
-    case Quality::HD     : m_tv_prefs_quality [id] = Quality::HD;     break;
-    case Quality::SD     : m_tv_prefs_quality [id] = Quality::SD;     break;
-    case Quality::LD     : m_tv_prefs_quality [id] = Quality::LD;     break;
-    case Quality::STEREO : m_tv_prefs_quality [id] = Quality::STEREO; break;
-    default              : break;
-  }
+    P8PLATFORM::CLockObject lock (m_mutex);
+    m_tv_prefs_quality.Update ([id, quality] (map<unsigned int, enum Quality> & prefs)
+    {
+      switch (quality)
+      {
+        case Quality::AUTO   : prefs.erase (id); break;
+        case Quality::HD     : prefs [id] = Quality::HD;     break;
+        case Quality::SD     : prefs [id] = Quality::SD;     break;
+        case Quality::LD     : prefs [id] = Quality::LD;     break;
+        case Quality::STEREO : prefs [id] = Quality::STEREO; break;
+        default              : break;
+      }
+    });
 
-  Document d (kObjectType);
-  auto & a = d.GetAllocator ();
-  for (auto & i : m_tv_prefs_quality)
-    d.AddMember (Value ("uuid-webtv-" + to_string (i.first), a), Value (StrQuality (i.second), a), a);
+    auto prefs = m_tv_prefs_quality.Load ();
+    auto f = prefs->find (id);
+    value = f != prefs->end () ? StrQuality (f->second) : "";
+  }
 
-  ofstream ofs (m_path + "quality.txt");
-  OStreamWrapper wrapper (ofs);
-  Writer<OStreamWrapper> writer (wrapper);
-  d.Accept (writer);
+  // Written behind (empty = erased).
+  m_tv_prefs.Set ("quality:uuid-webtv-" + to_string (id), value);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -1298,17 +2027,17 @@ Freebox::Recording::Recording (const Value & json) :
 
 void Freebox::ProcessRecordings ()
 {
-  m_recordings.clear ();
+  map<int, Recording> recordings;
 
-  Document recordings;
-  if (GET ("/api/v6/pvr/finished/", &recordings, kArrayType))
+  auto recording = [&recordings] (const Keys &, const Value & r)
   {
-    Value & result = recordings ["result"];
-    for (SizeType i = 0; i < result.Size (); ++i)
-    {
-      int id = result[i]["id"].GetInt ();
-      m_recordings.emplace (id, Recording (result [i]));
-    }
+    int id = r["id"].GetInt ();
+    recordings.emplace (id, Recording (r));
+  };
+
+  if (GET ("/api/v6/pvr/finished/", 1, recording))
+  {
+    m_recordings.Store (move (recordings));
 
     PVR->TriggerRecordingUpdate ();
   }
@@ -1316,18 +2045,17 @@ void Freebox::ProcessRecordings ()
 
 int Freebox::GetRecordingsAmount (bool deleted) const
 {
-  P8PLATFORM::CLockObject lock (m_mutex);
-  return m_recordings.size ();
+  return m_recordings.Load ()->size ();
 }
 
 PVR_ERROR Freebox::GetRecordings (ADDON_HANDLE handle, bool deleted) const
 {
-  P8PLATFORM::CLockObject lock (m_mutex);
+  auto recordings = m_recordings.Load ();
 
 #if __cplusplus >= 201703L
-  for (auto & [id, r] : m_recordings)
+  for (auto & [id, r] : *recordings)
 #else
-  for (auto & it : m_recordings)
+  for (auto & it : *recordings)
 #endif
   {
 #if __cplusplus < 201703L
@@ -1356,20 +2084,23 @@ PVR_ERROR Freebox::GetRecordings (ADDON_HANDLE handle, bool deleted) const
   return PVR_ERROR_NO_ERROR;
 }
 
-PVR_ERROR Freebox::GetRecordingStreamProperties (const PVR_RECORDING * recording, PVR_NAMED_VALUE * properties, unsigned int * count) const
+PVR_ERROR Freebox::GetRecordingStreamProperties (const PVR_RECORDING * recording, PVR_NAMED_VALUE * properties, unsigned int * count)
 {
   if (! recording || ! properties || ! count || *count < 2)
     return PVR_ERROR_INVALID_PARAMETERS;
 
+  // Signal status polls are no longer about the last zap.
+  m_tv_health.Cancel ();
+
   int id = stoi (recording->strRecordingId);
 
-  P8PLATFORM::CLockObject lock (m_mutex);
-  auto i = m_recordings.find (id);
-  if (i == m_recordings.end ())
+  auto recordings = m_recordings.Load ();
+  auto i = recordings->find (id);
+  if (i == recordings->end ())
     return PVR_ERROR_SERVER_ERROR;
 
   const Recording & r = i->second;
-  string stream = "smb://" + m_server + '/' + r.media + '/' + r.path + '/' + r.filename;
+  string stream = "smb://" + GetServer () + '/' + r.media + '/' + r.path + '/' + r.filename;
   strncpy (properties[0].strName,  PVR_STREAM_PROPERTY_STREAMURL,        PVR_ADDON_NAME_STRING_LENGTH - 1);
   strncpy (properties[0].strValue, stream.c_str (),                      PVR_ADDON_NAME_STRING_LENGTH - 1);
   strncpy (properties[1].strName,  PVR_STREAM_PROPERTY_ISREALTIMESTREAM, PVR_ADDON_NAME_STRING_LENGTH - 1);
@@ -1379,6 +2110,12 @@ PVR_ERROR Freebox::GetRecordingStreamProperties (const PVR_RECORDING * recording
   return PVR_ERROR_NO_ERROR;
 }
 
+bool Freebox::HasRecording (int id) const
+{
+  auto recordings = m_recordings.Load ();
+  return recordings->find (id) != recordings->end ();
+}
+
 PVR_ERROR Freebox::RenameRecording (const PVR_RECORDING & recording)
 {
   StartSession ();
@@ -1387,9 +2124,7 @@ PVR_ERROR Freebox::RenameRecording (const PVR_RECORDING & recording)
   string name    = recording.strTitle;
   string subname = recording.strEpisodeName;
 
-  P8PLATFORM::CLockObject lock (m_mutex);
-  auto i = m_recordings.find (id);
-  if (i == m_recordings.end ())
+  if (! HasRecording (id))
     return PVR_ERROR_SERVER_ERROR;
 
   // Payload.
@@ -1403,7 +2138,14 @@ PVR_ERROR Freebox::RenameRecording (const PVR_RECORDING & recording)
     return PVR_ERROR_SERVER_ERROR;
 
   // Update recording (locally).
-  i->second = Recording (response["result"]);
+  Recording r (response["result"]);
+  m_mutex.Lock ();
+  m_recordings.Update ([id, &r] (map<int, Recording> & recordings)
+  {
+    auto i = recordings.find (id);
+    if (i != recordings.end ()) i->second = r;
+  });
+  m_mutex.Unlock ();
   PVR->TriggerRecordingUpdate ();
 
   return PVR_ERROR_NO_ERROR;
@@ -1415,9 +2157,7 @@ PVR_ERROR Freebox::DeleteRecording (const PVR_RECORDING & recording)
 
   int id = stoi (recording.strRecordingId);
 
-  P8PLATFORM::CLockObject lock (m_mutex);
-  auto i = m_recordings.find (id);
-  if (i == m_recordings.end ())
+  if (! HasRecording (id))
     return PVR_ERROR_SERVER_ERROR;
 
   // Delete recording (Freebox).
@@ -1426,7 +2166,9 @@ PVR_ERROR Freebox::DeleteRecording (const PVR_RECORDING & recording)
     return PVR_ERROR_SERVER_ERROR;
 
   // Delete recording (locally).
-  m_recordings.erase (i);
+  m_mutex.Lock ();
+  m_recordings.Update ([id] (map<int, Recording> & recordings) {recordings.erase (id);});
+  m_mutex.Unlock ();
   PVR->TriggerRecordingUpdate ();
 
   return PVR_ERROR_NO_ERROR;
@@ -1465,18 +2207,18 @@ Freebox::Generator::Generator (const Value & json) :
 
 void Freebox::ProcessGenerators ()
 {
-  m_generators.clear ();
+  map<int, Generator> generators;
 
-  Document generators;
-  if (GET ("/api/v6/pvr/generator/", &generators, kArrayType))
+  auto generator = [this, &generators] (const Keys &, const Value & g)
   {
-    Value & result = generators ["result"];
-    for (SizeType i = 0; i < result.Size (); ++i)
-    {
-      int        id = result[i]["id"].GetInt ();
-      int unique_id = m_unique_id ("generator/" + to_string (id));
-      m_generators.emplace (unique_id, Generator (result [i]));
-    }
+    int        id = g["id"].GetInt ();
+    int unique_id = UniqueId ("generator/" + to_string (id));
+    generators.emplace (unique_id, Generator (g));
+  };
+
+  if (GET ("/api/v6/pvr/generator/", 1, generator))
+  {
+    m_generators.Store (move (generators));
 
     PVR->TriggerTimerUpdate ();
   }
@@ -1507,26 +2249,32 @@ Freebox::Timer::Timer (const Value & json) :
 
 void Freebox::ProcessTimers ()
 {
-  m_timers.clear ();
+  map<int, Timer> timers;
 
-  Document timers;
-  if (GET ("/api/v6/pvr/programmed/", &timers, kArrayType))
+  auto timer = [this, &timers] (const Keys &, const Value & t)
   {
-    Value & result = timers ["result"];
-    for (SizeType i = 0; i < result.Size (); ++i)
-    {
-      int        id = result[i]["id"].GetInt ();
-      int unique_id = m_unique_id ("programmed/" + to_string (id));
+    int        id = t["id"].GetInt ();
+    int unique_id = UniqueId ("programmed/" + to_string (id));
 
-      const string & state = result[i]["state"].GetString ();
-      if (state != "finished" && state != "failed" && state != "start_error" && state != "running_error")
-        m_timers.emplace (unique_id, Timer (result [i]));
-    }
+    const string & state = t["state"].GetString ();
+    if (state != "finished" && state != "failed" && state != "start_error" && state != "running_error")
+      timers.emplace (unique_id, Timer (t));
+  };
+
+  if (GET ("/api/v6/pvr/programmed/", 1, timer))
+  {
+    m_timers.Store (move (timers));
 
     PVR->TriggerTimerUpdate ();
   }
 }
 
+int Freebox::UniqueId (const string & key) const
+{
+  P8PLATFORM::CLockObject lock (m_mutex);
+  return m_unique_id (key);
+}
+
 PVR_ERROR Freebox::GetTimerTypes (PVR_TIMER_TYPE types [], int * size) const
 {
   if (! size || *size < 5)
@@ -1605,19 +2353,19 @@ PVR_ERROR Freebox::GetTimerTypes (PVR_TIMER_TYPE types [], int * size) const
 
 int Freebox::GetTimersAmount () const
 {
-  P8PLATFORM::CLockObject lock (m_mutex);
-  return m_generators.size () + m_timers.size ();
+  return m_generators.Load ()->size () + m_timers.Load ()->size ();
 }
 
 PVR_ERROR Freebox::GetTimers (ADDON_HANDLE handle) const
 {
-  P8PLATFORM::CLockObject lock (m_mutex);
+  auto generators = m_generators.Load ();
+  auto timers     = m_timers.Load ();
   //cout << "Freebox::GetTimers" << endl;
 
 #if __cplusplus >= 201703L
-  for (auto & [id, g] : m_generators)
+  for (auto & [id, g] : *generators)
 #else
-  for (auto & it : m_generators)
+  for (auto & it : *generators)
 #endif
   {
 #if __cplusplus < 201703L
@@ -1657,9 +2405,9 @@ PVR_ERROR Freebox::GetTimers (ADDON_HANDLE handle) const
   }
 
 #if __cplusplus >= 201703L
-  for (auto & [id, t] : m_timers)
+  for (auto & [id, t] : *timers)
 #else
-  for (auto & it : m_timers)
+  for (auto & it : *timers)
 #endif
   {
 #if __cplusplus < 201703L
@@ -1673,7 +2421,7 @@ PVR_ERROR Freebox::GetTimers (ADDON_HANDLE handle) const
     if (t.has_record_gen)
     {
       timer.iTimerType         = PVR_FREEBOX_TIMER_GENERATED;
-      timer.iParentClientIndex = m_unique_id ("generator/" + to_string (t.record_gen_id));
+      timer.iParentClientIndex = UniqueId ("generator/" + to_string (t.record_gen_id));
     }
     else
     {
@@ -1743,6 +2491,20 @@ inline Document freebox_generator_request (const PVR_TIMER & timer)
   return d;
 }
 
+int Freebox::TimerId (int unique) const
+{
+  auto timers = m_timers.Load ();
+  auto i = timers->find (unique);
+  return i != timers->end () ? i->second.id : -1;
+}
+
+int Freebox::GeneratorId (int unique) const
+{
+  auto generators = m_generators.Load ();
+  auto i = generators->find (unique);
+  return i != generators->end () ? i->second.id : -1;
+}
+
 PVR_ERROR Freebox::AddTimer (const PVR_TIMER & timer)
 {
   StartSession ();
@@ -1752,7 +2514,6 @@ PVR_ERROR Freebox::AddTimer (const PVR_TIMER & timer)
   string channel_uuid = "uuid-webtv-" + to_string (channel);
   string title        = timer.strTitle;
 
-  P8PLATFORM::CLockObject lock (m_mutex);
   switch (type)
   {
     case PVR_FREEBOX_TIMER_MANUAL :
@@ -1798,8 +2559,11 @@ PVR_ERROR Freebox::AddTimer (const PVR_TIMER & timer)
 
       // Add timer (locally).
       int id     = response["result"]["id"].GetInt ();
-      int unique = m_unique_id ("programmed/" + to_string (id));
-      m_timers.emplace (unique, Timer (response["result"]));
+      int unique = UniqueId ("programmed/" + to_string (id));
+      Timer t (response["result"]);
+      m_mutex.Lock ();
+      m_timers.Update ([unique, &t] (map<int, Timer> & timers) {timers.emplace (unique, t);});
+      m_mutex.Unlock ();
       PVR->TriggerTimerUpdate ();
 
       // Update recordings if timer is running.
@@ -1826,8 +2590,11 @@ PVR_ERROR Freebox::AddTimer (const PVR_TIMER & timer)
 
       // Add generator (locally).
       int id     = response["result"]["id"].GetInt ();
-      int unique = m_unique_id ("generator/" + to_string (id));
-      m_generators.emplace (unique, Generator (response["result"]));
+      int unique = UniqueId ("generator/" + to_string (id));
+      Generator g (response["result"]);
+      m_mutex.Lock ();
+      m_generators.Update ([unique, &g] (map<int, Generator> & generators) {generators.emplace (unique, g);});
+      m_mutex.Unlock ();
 
       // Reload timers.
       ProcessTimers ();
@@ -1858,12 +2625,9 @@ PVR_ERROR Freebox::UpdateTimer (const PVR_TIMER & timer)
     case PVR_FREEBOX_TIMER_MANUAL :
     case PVR_FREEBOX_TIMER_EPG :
     {
-      P8PLATFORM::CLockObject lock (m_mutex);
-      auto i = m_timers.find (timer.iClientIndex);
-      if (i == m_timers.end ())
+      int id = TimerId (timer.iClientIndex);
+      if (id < 0)
         return PVR_ERROR_SERVER_ERROR;
-
-      int id = i->second.id;
       //cout << "UpdateTimer: TIMER[" << type << "]: " << timer.iClientIndex << " > " << id << endl;
 
       string channel_uuid = "uuid-webtv-" + to_string (timer.iClientChannelUid);
@@ -1891,7 +2655,14 @@ PVR_ERROR Freebox::UpdateTimer (const PVR_TIMER & timer)
         return PVR_ERROR_SERVER_ERROR;
 
       // Update timer (locally).
-      i->second = Timer (response["result"]);
+      Timer t (response["result"]);
+      m_mutex.Lock ();
+      m_timers.Update ([&timer, &t] (map<int, Timer> & timers)
+      {
+        auto i = timers.find (timer.iClientIndex);
+        if (i != timers.end ()) i->second = t;
+      });
+      m_mutex.Unlock ();
       //cout << "UpdateTimer: TIMER[" << type << "]: '" << i->second.state << "'" << endl;
       PVR->TriggerTimerUpdate ();
 
@@ -1900,12 +2671,9 @@ PVR_ERROR Freebox::UpdateTimer (const PVR_TIMER & timer)
 
     case PVR_FREEBOX_TIMER_GENERATED :
     {
-      P8PLATFORM::CLockObject lock (m_mutex);
-      auto i = m_timers.find (timer.iClientIndex);
-      if (i == m_timers.end ())
+      int id = TimerId (timer.iClientIndex);
+      if (id < 0)
         return PVR_ERROR_SERVER_ERROR;
-
-      int id = i->second.id;
       //cout << "UpdateTimer: TIMER_GENERATED: " << timer.iClientIndex << " > " << id << endl;
 
       // Payload.
@@ -1918,7 +2686,14 @@ PVR_ERROR Freebox::UpdateTimer (const PVR_TIMER & timer)
         return PVR_ERROR_SERVER_ERROR;
 
       // Update generated timer (locally).
-      i->second = Timer (response["result"]);
+      Timer t (response["result"]);
+      m_mutex.Lock ();
+      m_timers.Update ([&timer, &t] (map<int, Timer> & timers)
+      {
+        auto i = timers.find (timer.iClientIndex);
+        if (i != timers.end ()) i->second = t;
+      });
+      m_mutex.Unlock ();
       //cout << "UpdateTimer: TIMER_GENERATED: '" << i->second.state << "'" << endl;
       PVR->TriggerTimerUpdate ();
 
@@ -1928,12 +2703,9 @@ PVR_ERROR Freebox::UpdateTimer (const PVR_TIMER & timer)
     case PVR_FREEBOX_GENERATOR_MANUAL :
     case PVR_FREEBOX_GENERATOR_EPG :
     {
-      P8PLATFORM::CLockObject lock (m_mutex);
-      auto i = m_generators.find (timer.iClientIndex);
-      if (i == m_generators.end ())
+      int id = GeneratorId (timer.iClientIndex);
+      if (id < 0)
         return PVR_ERROR_SERVER_ERROR;
-
-      int id = i->second.id;
       //cout << "UpdateTimer: GENERATOR[" << type << "]: " << timer.iClientIndex << " > " << id << endl;
 
       // Payload.
@@ -1945,7 +2717,14 @@ PVR_ERROR Freebox::UpdateTimer (const PVR_TIMER & timer)
         return PVR_ERROR_SERVER_ERROR;
 
       // Update generator (locally).
-      i->second = Generator (response["result"]);
+      Generator g (response["result"]);
+      m_mutex.Lock ();
+      m_generators.Update ([&timer, &g] (map<int, Generator> & generators)
+      {
+        auto i = generators.find (timer.iClientIndex);
+        if (i != generators.end ()) i->second = g;
+      });
+      m_mutex.Unlock ();
       ProcessTimers ();
       ProcessRecordings ();
 
@@ -1973,12 +2752,9 @@ PVR_ERROR Freebox::DeleteTimer (const PVR_TIMER & timer, bool force)
     case PVR_FREEBOX_TIMER_MANUAL :
     case PVR_FREEBOX_TIMER_EPG :
     {
-      P8PLATFORM::CLockObject lock (m_mutex);
-      auto i = m_timers.find (timer.iClientIndex);
-      if (i == m_timers.end ())
+      int id = TimerId (timer.iClientIndex);
+      if (id < 0)
         return PVR_ERROR_SERVER_ERROR;
-
-      int id = i->second.id;
       //cout << "DeleteTimer: TIMER[" << type << "]: " << timer.iClientIndex << " > " << id << endl;
 
       // Delete timer (Freebox).
@@ -1987,7 +2763,9 @@ PVR_ERROR Freebox::DeleteTimer (const PVR_TIMER & timer, bool force)
         return PVR_ERROR_SERVER_ERROR;
 
       // Delete timer (locally).
-      m_timers.erase (i);
+      m_mutex.Lock ();
+      m_timers.Update ([&timer] (map<int, Timer> & timers) {timers.erase (timer.iClientIndex);});
+      m_mutex.Unlock ();
       PVR->TriggerTimerUpdate ();
 
       // Update recordings if timer was running.
@@ -2000,12 +2778,9 @@ PVR_ERROR Freebox::DeleteTimer (const PVR_TIMER & timer, bool force)
     case PVR_FREEBOX_GENERATOR_MANUAL :
     case PVR_FREEBOX_GENERATOR_EPG :
     {
-      P8PLATFORM::CLockObject lock (m_mutex);
-      auto i = m_generators.find (timer.iClientIndex);
-      if (i == m_generators.end ())
+      int id = GeneratorId (timer.iClientIndex);
+      if (id < 0)
         return PVR_ERROR_SERVER_ERROR;
-
-      int id = i->second.id;
       //cout << "DeleteTimer: GENERATOR[" << type << "]: " << timer.iClientIndex << " > " << id << endl;
 
       // Delete generator (Freebox).
@@ -2013,15 +2788,22 @@ PVR_ERROR Freebox::DeleteTimer (const PVR_TIMER & timer, bool force)
       if (! DELETE ("/api/v6/pvr/generator/" + to_string (id), &response))
         return PVR_ERROR_SERVER_ERROR;
 
+      m_mutex.Lock ();
+
       // Delete generated timers (locally).
-      for (auto i = m_timers.begin (); i != m_timers.end ();)
-        if (i->second.record_gen_id == id)
-          i = m_timers.erase (i);
-        else
-          ++i;
+      m_timers.Update ([id] (map<int, Timer> & timers)
+      {
+        for (auto i = timers.begin (); i != timers.end ();)
+          if (i->second.record_gen_id == id)
+            i = timers.erase (i);
+          else
+            ++i;
+      });
 
       // Delete generator (locally).
-      m_generators.erase (i);
+      m_generators.Update ([&timer] (map<int, Generator> & generators) {generators.erase (timer.iClientIndex);});
+
+      m_mutex.Unlock ();
       PVR->TriggerTimerUpdate ();
 
       break;
@@ -2114,6 +2896,13 @@ PVR_ERROR Freebox::MenuHook (const PVR_MENUHOOK & hook, const PVR_MENUHOOK_DATA
 
       return PVR_ERROR_NO_ERROR;
     }
+
+    case PVR_FREEBOX_MENUHOOK_EPG_DETAILS:
+    {
+      RequestDetails (data.data.iEpgUid);
+
+      return PVR_ERROR_NO_ERROR;
+    }
   }
 
   return PVR_ERROR_NO_ERROR;
@@ -22,13 +22,22 @@
 
 #include <set>
 #include <map>
-#include <queue>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <functional>
 #include <algorithm> // find_if
+#include <cstdlib> // strtoul
 #include "libXBMC_pvr.h"
 #include "libKODI_guilib.h"
 #include "p8-platform/os.h"
 #include "p8-platform/threads/threads.h"
 #include "rapidjson/document.h"
+#include "HTTP.h"
+#include "EPG.h"
+#include "Bouquet.h"
+#include "Health.h"
+#include "Prefs.h"
 
 #define PVR_FREEBOX_VERSION "2.1.1"
 
@@ -42,6 +51,7 @@
 
 #define PVR_FREEBOX_MENUHOOK_CHANNEL_SOURCE  1
 #define PVR_FREEBOX_MENUHOOK_CHANNEL_QUALITY 2
+#define PVR_FREEBOX_MENUHOOK_EPG_DETAILS     3
 
 #define PVR_FREEBOX_STRING_CHANNELS_LOADED      30000
 #define PVR_FREEBOX_STRING_AUTH_REQUIRED        30001
@@ -55,6 +65,7 @@
 #define PVR_FREEBOX_STRING_CHANNEL_QUALITY_SD   30017
 #define PVR_FREEBOX_STRING_CHANNEL_QUALITY_LD   30018
 #define PVR_FREEBOX_STRING_CHANNEL_QUALITY_3D   30019
+#define PVR_FREEBOX_STRING_EPG_DETAILS          30035
 
 #undef DELETE
 
@@ -86,6 +97,47 @@ class Index
     }
 };
 
+// Immutable data, read without locking and replaced as a whole (RCU-style).
+// Readers keep their own reference: a snapshot never changes under them.
+template <typename T>
+class Snapshot
+{
+  public:
+    typedef std::shared_ptr<const T> Pointer;
+
+  private:
+    Pointer m_data;
+
+  public:
+    inline
+    Snapshot () :
+      m_data (std::make_shared<const T> ())
+    {
+    }
+
+    inline
+    Pointer Load () const
+    {
+      return std::atomic_load (&m_data);
+    }
+
+    inline
+    void Store (T && data)
+    {
+      std::atomic_store (&m_data, Pointer (std::make_shared<T> (std::move (data))));
+    }
+
+    // Copy, modify, publish: writers must be serialized!
+    template <typename F>
+    inline
+    void Update (const F & f)
+    {
+      T data (*Load ());
+      f (data);
+      Store (std::move (data));
+    }
+};
+
 class Freebox :
   public P8PLATFORM::CThread
 {
@@ -100,6 +152,11 @@ class Freebox :
       return std::stoi (uuid.substr (6)); // pluri_*
     }
 
+    inline static unsigned int BroadcastId (const char * uuid)
+    {
+      return std::strtoul (uuid + 6, NULL, 10); // pluri_*
+    }
+
     // Channel source.
     enum class Source {DEFAULT = -1, AUTO = 0, IPTV = 1, DVB = 2};
 
@@ -135,6 +192,7 @@ class Freebox :
         int                 major;
         int                 minor;
         std::vector<Stream> streams;
+        int                 best [3][5]; // stream index, by (source, quality) (-1 = none)
 
       public:
         Channel (const std::string & uuid,
@@ -144,11 +202,29 @@ class Freebox :
                  const std::vector<Stream> &);
 
         bool IsHidden () const;
-        void GetChannel (ADDON_HANDLE, bool radio) const;
-        PVR_ERROR GetStreamProperties (enum Source, enum Quality,
+        void GetChannel (PVR_CHANNEL *) const;
+        // Stream index (-1 = none): streams of a penalized channel are rescored.
+        int BestStream (enum Source, enum Quality, const StreamHealth &) const;
+        PVR_ERROR GetStreamProperties (enum Source, enum Quality, StreamHealth &,
                                        PVR_NAMED_VALUE *, unsigned int * count) const;
     };
 
+    typedef std::map<unsigned int, Channel> Channels;
+    // Ready for Kodi (same order).
+    typedef std::vector<PVR_CHANNEL> ChannelTable;
+
+    // EPG slot (one hour), refreshed as a whole.
+    class Slot
+    {
+      public:
+        int    generation; // number of fetches
+        bool   pending;    // queued or running
+        EPGSet events;     // broadcast ids starting here, sent to Kodi
+
+      public:
+        Slot () : generation (0), pending (false), events (64) {}
+    };
+
     // Query types.
     enum QueryType {NONE = 0, FULL = 1, CHANNEL = 2, EVENT = 3};
 
@@ -175,38 +251,44 @@ class Freebox :
         }
     };
 
-    // EPG events.
-    class Event
+    // EPG query scheduler: one FIFO per class, most urgent class first.
+    // Waiting queries are promoted one class every AGING ms (no starvation).
+    // NOT thread-safe !
+    class Scheduler
     {
       public:
-        static std::string Native (int);
-        static int         Colors (int);
+        enum Class {NOW = 0, TODAY = 1, CHANNEL = 2, EXTENDED = 3, LATER = 4, CLASSES = 5};
+        static const int64_t AGING = 30000;
 
-      public:
-        class CastMember
-        {
-          public:
-            std::string job;
-            std::string first_name;
-            std::string last_name;
-            std::string role;
+      private:
+        typedef std::pair<int64_t, Query> Item; // enqueued (ms)
+        std::deque<Item> m_queues [CLASSES];
 
-          public:
-            CastMember (const rapidjson::Value &);
-        };
+      public:
+        void   Push  (Class, const Query &);
+        bool   Pop   (Query *);
+        bool   Empty () const;
+        size_t Size  (Class) const;
+    };
 
-        typedef std::vector<CastMember> Cast;
+    // EPG worker: drains the query queue.
+    class Worker :
+      public P8PLATFORM::CThread
+    {
+      private:
+        Freebox * m_freebox;
 
-      protected:
-        class ConcatIfJob
-        {
-          private:
-            std::string m_job;
+      public:
+        Worker (Freebox *);
+        virtual void * Process ();
+    };
 
-          public:
-            ConcatIfJob (const std::string & job);
-            std::string operator() (const std::string &, const Freebox::Event::CastMember &) const;
-        };
+    // EPG events.
+    class Event
+    {
+      public:
+        static const char * Native (int);
+        static int          Colors (int);
 
       public:
         unsigned int channel;
@@ -222,12 +304,9 @@ class Freebox :
         std::string  plot;
         std::string  outline;
         int          year;
-        Cast         cast;
 
       public:
         Event (const rapidjson::Value &, unsigned int channel, time_t date);
-        std::string GetCastDirector () const;
-        std::string GetCastActors   () const;
     };
 
     // Generator.
@@ -316,9 +395,24 @@ class Freebox :
     };
 
   public:
-    Freebox (const std::string & path, int source, int quality, int days, bool extended, bool colors, int delay);
+    // Consumes a response body.
+    typedef std::function<void (HTTPStream &)> Parser;
+
+  protected:
+    // Streamed records (keys from "result").
+    typedef std::vector<std::string> Keys;
+    typedef std::function<void (const Keys &, const rapidjson::Value &)> Records;
+
+    class RecordReader;
+
+  public:
+    Freebox (const std::string & path, int source, int quality, int days, bool extended, int window, int budget, bool colors, int delay, int connections, int keepalive, int workers);
     virtual ~Freebox ();
 
+    // Background threads (Process + EPG workers).
+    void Start ();
+    void Stop ();
+
     // Freebox Server.
     std::string GetServer () const;
 
@@ -330,10 +424,21 @@ class Freebox :
     void SetDays (int);
     // Extended EPG.
     void SetExtended (bool);
+    // Extended EPG window (hours).
+    void SetWindow (int);
+    // EPG memory budget (MB, 0 = unlimited).
+    void SetBudget (int);
     // Colored Categories.
     void SetColors (bool);
     // Delay setting.
     void SetDelay (int);
+    // Connection pool size.
+    void SetConnections (int);
+    // Keep-alive timeout.
+    void SetKeepAlive (int);
+
+    // E P G /////////////////////////////////////////////////////////////////
+    PVR_ERROR GetEPGForChannel (ADDON_HANDLE, int id, time_t start, time_t end);
 
     // C H A N N E L S /////////////////////////////////////////////////////////
     int       GetChannelsAmount ();
@@ -342,11 +447,13 @@ class Freebox :
     PVR_ERROR GetChannelGroups (ADDON_HANDLE, bool radio);
     PVR_ERROR GetChannelGroupMembers (ADDON_HANDLE, const PVR_CHANNEL_GROUP &);
     PVR_ERROR GetChannelStreamProperties (const PVR_CHANNEL *, PVR_NAMED_VALUE *, unsigned int * count);
+    // Playback started (first signal status poll after a zap).
+    void StreamStarted ();
 
     // R E C O R D I N G S /////////////////////////////////////////////////////
     int       GetRecordingsAmount (bool deleted) const;
     PVR_ERROR GetRecordings (ADDON_HANDLE, bool deleted) const;
-    PVR_ERROR GetRecordingStreamProperties (const PVR_RECORDING *, PVR_NAMED_VALUE *, unsigned int * count) const;
+    PVR_ERROR GetRecordingStreamProperties (const PVR_RECORDING *, PVR_NAMED_VALUE *, unsigned int * count);
     PVR_ERROR RenameRecording (const PVR_RECORDING &);
     PVR_ERROR DeleteRecording (const PVR_RECORDING &);
 
@@ -365,39 +472,80 @@ class Freebox :
     virtual void * Process ();
 
     // H T T P /////////////////////////////////////////////////////////////////
+    virtual
+    int  HTTP   (const std::string & custom,
+                 const std::string & url,
+                 const rapidjson::Document &,
+                 const Parser &);
     bool HTTP   (const std::string & custom,
                  const std::string & url,
                  const rapidjson::Document &,
-                 rapidjson::Document *, rapidjson::Type = rapidjson::kObjectType) const;
+                 rapidjson::Document *, rapidjson::Type = rapidjson::kObjectType);
     bool GET    (const std::string & url,
-                 rapidjson::Document *, rapidjson::Type = rapidjson::kObjectType) const;
+                 rapidjson::Document *, rapidjson::Type = rapidjson::kObjectType);
+    // Streamed GET: 'level' = depth of records below "result".
+    bool GET    (const std::string & url,
+                 int level, const Records &);
     bool POST   (const std::string & url,
                  const rapidjson::Document &,
-                 rapidjson::Document *, rapidjson::Type = rapidjson::kObjectType) const;
+                 rapidjson::Document *, rapidjson::Type = rapidjson::kObjectType);
     bool PUT    (const std::string & url,
                  const rapidjson::Document &,
-                 rapidjson::Document *, rapidjson::Type = rapidjson::kObjectType) const;
-    bool DELETE (const std::string & url, rapidjson::Document *) const;
+                 rapidjson::Document *, rapidjson::Type = rapidjson::kObjectType);
+    bool DELETE (const std::string & url, rapidjson::Document *);
 
-    // Session.
+    // Session (assumed valid until a query fails with an authentication error).
     bool StartSession ();
     bool CloseSession ();
-
-    // Process JSON channels.
+    bool RenewSession (const std::string & url, const std::string & session, const std::string & error);
+    std::string SessionToken () const;
+
+    // Channel snapshot (binary).
+    static std::string WriteChannels (const Channels &);
+    static bool ReadChannels (const std::string &, Channels *);
+    bool LoadChannels ();
+    void LoadPreferences ();
+    // Publishes channels, along with their PVR_CHANNEL table.
+    void StoreChannels (Channels &&);
+
+    // Process JSON channels (only published if changed).
     bool ProcessChannels ();
 
-    // Process JSON EPG.
-    void ProcessFull    (const rapidjson::Value & epg);
-    void ProcessChannel (const rapidjson::Value & epg, unsigned int channel);
-    void ProcessEvent   (const rapidjson::Value & epg, unsigned int channel, time_t, EPG_EVENT_STATE);
+    // EPG queries.
+    // High priority CHANNEL query (once per channel and slot).
+    void RequestChannel (unsigned int id, time_t slot);
+    // Extended details: cached, or fetched (if 'fetch').
+    void RequestDetails (unsigned int broadcast, unsigned int channel, time_t date, Scheduler::Class, bool fetch);
+    // Extended details of a known event, asked for by the user.
+    void RequestDetails (unsigned int broadcast);
+    bool PopQuery     (Query *);
+    void ProcessQuery (const Query &);
+    void DoneQuery    ();
 
+    // Process JSON EPG.
+    void ProcessEntry   (const rapidjson::Value & epg, unsigned int channel);
     // If /api/v6/tv/epg/programs/* queries had a "date", things would be *way* easier!
-    void ProcessEvent   (const Event &, EPG_EVENT_STATE);
+    void ProcessEvent   (const rapidjson::Value & epg, unsigned int channel, time_t, EPG_EVENT_STATE, bool extended);
+    // Straight from the document: no copy, no allocation (once warmed up).
+    // Cast strings live in per-thread buffers (valid until the next call).
+    static EPGStore::View ParseEvent (const rapidjson::Value & epg, unsigned int channel, time_t, bool extended);
+    // Events gone from a (successfully fetched) slot are deleted.
+    void PurgeSlot      (time_t slot);
 
+    // EPG_TAG (valid during the call).
+    void TransferEntry  (const EPGStore::View &, const std::function<void (EPG_TAG *)> &);
+
+    // Fetched without holding m_mutex, then swapped in.
     void ProcessGenerators ();
     void ProcessTimers     ();
     void ProcessRecordings ();
 
+    // Thread-safe lookups (-1 if unknown).
+    int  UniqueId     (const std::string &) const;
+    int  TimerId      (int unique) const;
+    int  GeneratorId  (int unique) const;
+    bool HasRecording (int id) const;
+
     // Channel preferences.
     enum Source  ChannelSource  (unsigned int id, bool fallback = true);
     enum Quality ChannelQuality (unsigned int id, bool fallback = true);
@@ -427,11 +575,19 @@ class Freebox :
     std::string URL (const std::string & query) const;
 
   private:
+    // Short critical sections only: never held across network I/O.
+    // Snapshots are read without it, but written with it.
     mutable P8PLATFORM::CMutex m_mutex;
+    // Login in progress.
+    P8PLATFORM::CMutex m_session_mutex;
     // Add-on path.
     std::string m_path;
     // Freebox Server.
     std::string m_server;
+    // Keep-alive connections.
+    HTTPPool m_http;
+    // Rate limiter (all queries).
+    HTTPLimiter m_limiter;
     // Delay between queries.
     int m_delay;
     // Freebox OS //////////////////////////////////////////////////////////////
@@ -439,24 +595,36 @@ class Freebox :
     int m_track_id;
     std::string m_session_token;
     // TV //////////////////////////////////////////////////////////////////////
-    std::map<unsigned int, Channel> m_tv_channels;
-    enum Source  m_tv_source;
-    enum Quality m_tv_quality;
-    std::map<unsigned int, enum Source>  m_tv_prefs_source;
-    std::map<unsigned int, enum Quality> m_tv_prefs_quality;
+    Snapshot<Channels> m_tv_channels;
+    Snapshot<ChannelTable> m_tv_table;
+    std::atomic<enum Source>  m_tv_source;
+    std::atomic<enum Quality> m_tv_quality;
+    Snapshot<std::map<unsigned int, enum Source>>  m_tv_prefs_source;
+    Snapshot<std::map<unsigned int, enum Quality>> m_tv_prefs_quality;
+    PrefsStore m_tv_prefs; // both, on disk
+    StreamHealth m_tv_health;
     // EPG /////////////////////////////////////////////////////////////////////
-    std::queue<Query> m_epg_queries;
-    std::set<std::string> m_epg_cache;
+    Scheduler m_epg_queries;
+    std::set<std::pair<unsigned int, time_t>> m_epg_requested; // channel, slot
+    P8PLATFORM::CEvent m_epg_event;
+    std::vector<std::unique_ptr<Worker>> m_epg_workers;
+    int m_epg_busy;
+    std::map<time_t, Slot> m_epg_slots;
+    EPGStore m_epg_store;
     int m_epg_days;
-    time_t m_epg_last;
     bool m_epg_extended;
+    int  m_epg_window;                // hours
+    int    m_epg_budget;              // MB (0 = unlimited)
+    time_t m_epg_horizon;             // first evicted slot (0 = none)
+    EPGCache m_epg_details;           // extended details
+    EPGSet   m_epg_fetching;          // broadcast ids (EVENT queries)
     bool m_epg_colors;
     // Recordings //////////////////////////////////////////////////////////////
-    std::map<int, Recording> m_recordings;
+    Snapshot<std::map<int, Recording>> m_recordings;
     // Timers //////////////////////////////////////////////////////////////////
     mutable Index<std::string> m_unique_id;
-    std::map<int, Generator> m_generators;
-    std::map<int, Timer> m_timers;
+    Snapshot<std::map<int, Generator>> m_generators;
+    Snapshot<std::map<int, Timer>> m_timers;
 };
 
 template <> inline bool        Freebox::JSON<bool>        (const rapidjson::Value & json) {return json.GetBool   ();}
@@ -0,0 +1,758 @@
+/*
+ *      Copyright (C) 2018 Aassif Benassarou
+ *      http://github.com/aassif/pvr.freebox/
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include <string>
+#include <sstream>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+#include "HTTP.h"
+#include "p8-platform/util/timeutils.h"
+
+#ifdef TARGET_WINDOWS
+  #include <winsock2.h>
+  #include <ws2tcpip.h>
+  typedef SOCKET http_socket_t;
+  #define http_poll       WSAPoll
+  #define http_closesocket closesocket
+  #define http_pending    (WSAGetLastError () == WSAEWOULDBLOCK)
+#else
+  #include <sys/socket.h>
+  #include <netinet/in.h>
+  #include <netinet/tcp.h>
+  #include <netdb.h>
+  #include <poll.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+  #include <cerrno>
+  typedef int http_socket_t;
+  #define http_poll       poll
+  #define http_closesocket close
+  #define http_pending    (errno == EINPROGRESS)
+#endif
+
+#ifndef MSG_NOSIGNAL
+  #define MSG_NOSIGNAL 0
+#endif
+
+using namespace std;
+
+inline
+bool http_equals (const string & s1, const string & s2)
+{
+  return s1.size () == s2.size () &&
+         equal (s1.begin (), s1.end (), s2.begin (),
+                [] (char c1, char c2) {return tolower (c1) == tolower (c2);});
+}
+
+inline
+string http_trim (const string & s)
+{
+  size_t b = s.find_first_not_of (" \t");
+  size_t e = s.find_last_not_of  (" \t");
+  return b != string::npos ? s.substr (b, e - b + 1) : "";
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// S O C K E T /////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+inline
+bool http_nonblocking (http_socket_t s)
+{
+#ifdef TARGET_WINDOWS
+  u_long mode = 1;
+  return ioctlsocket (s, FIONBIO, &mode) == 0;
+#else
+  int flags = fcntl (s, F_GETFL, 0);
+  return flags >= 0 && fcntl (s, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+// Ready (true) or timeout / error (false).
+inline
+bool http_wait (http_socket_t s, short events, uint64_t timeout)
+{
+  pollfd p;
+  p.fd      = s;
+  p.events  = events;
+  p.revents = 0;
+  return http_poll (&p, 1, (int) timeout) == 1;
+}
+
+HTTPSocket::HTTPSocket (const string & host, uint16_t port) :
+  m_host (host),
+  m_port (port),
+  m_fd (-1)
+{
+}
+
+HTTPSocket::~HTTPSocket ()
+{
+  Close ();
+}
+
+bool HTTPSocket::Open (uint64_t timeout)
+{
+  Close ();
+
+  addrinfo hints;
+  memset (&hints, 0, sizeof (addrinfo));
+  hints.ai_family   = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_protocol = IPPROTO_TCP;
+
+  addrinfo * info = nullptr;
+  if (getaddrinfo (m_host.c_str (), to_string (m_port).c_str (), &hints, &info) != 0)
+    return false;
+
+  for (addrinfo * a = info; a && m_fd == -1; a = a->ai_next)
+  {
+    http_socket_t s = socket (a->ai_family, a->ai_socktype, a->ai_protocol);
+    if (s == (http_socket_t) -1) continue;
+
+    // Non-blocking connect, bounded by the timeout.
+    bool connected = http_nonblocking (s);
+    if (connected && connect (s, a->ai_addr, (socklen_t) a->ai_addrlen) != 0)
+    {
+      int error = 0;
+      socklen_t length = sizeof (error);
+      connected = http_pending && http_wait (s, POLLOUT, timeout) &&
+                  getsockopt (s, SOL_SOCKET, SO_ERROR, (char *) &error, &length) == 0 && error == 0;
+    }
+
+    if (connected)
+    {
+      int one = 1;
+      setsockopt (s, IPPROTO_TCP, TCP_NODELAY, (const char *) &one, sizeof (one));
+      m_fd = (intptr_t) s;
+    }
+    else
+      http_closesocket (s);
+  }
+
+  freeaddrinfo (info);
+  return m_fd != -1;
+}
+
+void HTTPSocket::Close ()
+{
+  if (m_fd != -1)
+    http_closesocket ((http_socket_t) m_fd);
+
+  m_fd = -1;
+}
+
+bool HTTPSocket::Write (const char * data, size_t size, uint64_t timeout)
+{
+  http_socket_t s = (http_socket_t) m_fd;
+  for (size_t n = 0; n < size;)
+  {
+    if (m_fd == -1 || ! http_wait (s, POLLOUT, timeout)) return false;
+    int r = send (s, data + n, (int) (size - n), MSG_NOSIGNAL);
+    if (r <= 0) return false;
+    n += r;
+  }
+
+  return true;
+}
+
+ssize_t HTTPSocket::Read (char * buffer, size_t size, uint64_t timeout)
+{
+  http_socket_t s = (http_socket_t) m_fd;
+  if (m_fd == -1 || ! http_wait (s, POLLIN, timeout)) return -1;
+  int r = recv (s, buffer, (int) size, 0);
+  return r >= 0 ? r : -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// C O N N E C T I O N /////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+HTTPConnection::HTTPConnection (const string & host, uint16_t port, uint64_t timeout) :
+  m_socket (host, port),
+  m_host (host),
+  m_timeout (timeout),
+  m_last (time (NULL)),
+  m_status (0),
+  m_headers (),
+  m_keep_alive (false),
+  m_chunked (false),
+  m_until_close (false),
+  m_eof (true),
+  m_remaining (0),
+  m_encoded (false),
+  m_zstream (),
+  m_begin (0),
+  m_end (0),
+  m_wire (0),
+  m_decoded (0)
+{
+}
+
+HTTPConnection::~HTTPConnection ()
+{
+  EndInflate ();
+  Close ();
+}
+
+void HTTPConnection::EndInflate ()
+{
+  if (m_encoded)
+    inflateEnd (&m_zstream);
+
+  m_encoded = false;
+}
+
+bool HTTPConnection::Open ()
+{
+  return m_socket.IsOpen () || m_socket.Open (m_timeout);
+}
+
+void HTTPConnection::Close ()
+{
+  m_socket.Close ();
+  m_begin = m_end = 0;
+  m_keep_alive = false;
+}
+
+bool HTTPConnection::IsOpen () const
+{
+  return m_socket.IsOpen ();
+}
+
+bool HTTPConnection::Send (const string & data)
+{
+  return m_socket.Write (data.data (), data.size (), m_timeout);
+}
+
+ssize_t HTTPConnection::Receive (char * buffer, size_t size)
+{
+  if (m_begin < m_end)
+  {
+    size_t n = min (size, m_end - m_begin);
+    memcpy (buffer, m_buffer + m_begin, n);
+    m_begin += n;
+    return n;
+  }
+
+  // Large reads skip the buffer.
+  if (size >= sizeof (m_buffer))
+    return m_socket.Read (buffer, size, m_timeout);
+
+  ssize_t n = m_socket.Read (m_buffer, sizeof (m_buffer), m_timeout);
+  if (n <= 0) return n;
+
+  m_begin = 0;
+  m_end   = n;
+  return Receive (buffer, size);
+}
+
+// Lines are scanned in the buffer (whatever follows is kept for the body).
+bool HTTPConnection::ReadLine (string * line)
+{
+  line->clear ();
+  for (;;)
+  {
+    if (m_begin == m_end)
+    {
+      ssize_t n = m_socket.Read (m_buffer, sizeof (m_buffer), m_timeout);
+      if (n <= 0) return false;
+      m_begin = 0;
+      m_end   = n;
+    }
+
+    const char * b = m_buffer + m_begin;
+    const char * e = (const char *) memchr (b, '\n', m_end - m_begin);
+    if (! e)
+    {
+      line->append (b, m_end - m_begin);
+      m_begin = m_end;
+      continue;
+    }
+
+    line->append (b, e - b);
+    m_begin += e - b + 1;
+    if (! line->empty () && line->back () == '\r')
+      line->pop_back ();
+    return true;
+  }
+}
+
+bool HTTPConnection::ReadChunk ()
+{
+  string line;
+  if (! ReadLine (&line)) return false;
+
+  // Chunk extensions are ignored.
+  m_remaining = strtoull (line.c_str (), NULL, 16);
+
+  if (m_remaining == 0)
+  {
+    // Trailer.
+    do if (! ReadLine (&line)) return false; while (! line.empty ());
+    m_eof = true;
+  }
+
+  return true;
+}
+
+bool HTTPConnection::Request (const string & method,
+                              const string & path,
+                              const Headers & headers,
+                              const string & body)
+{
+  m_status      = 0;
+  m_headers.clear ();
+  m_keep_alive  = false;
+  m_chunked     = false;
+  m_until_close = false;
+  m_eof         = false;
+  m_remaining   = 0;
+  m_last        = time (NULL);
+  m_wire        = 0;
+  m_decoded     = 0;
+  EndInflate ();
+
+  // Leftovers from a previous response: the connection is out of sync.
+  if (m_begin != m_end)
+    Close ();
+
+  if (! Open ()) return false;
+
+  ostringstream oss;
+  oss << method << ' ' << path << " HTTP/1.1\r\n";
+  oss << "Host: " << m_host << "\r\n";
+  oss << "Connection: keep-alive\r\n";
+  oss << "Accept-Encoding: gzip, deflate\r\n";
+  for (auto & h : headers)
+    oss << h.first << ": " << h.second << "\r\n";
+  if (! body.empty ())
+    oss << "Content-Type: application/json\r\n";
+  if (! body.empty () || method == "POST" || method == "PUT")
+    oss << "Content-Length: " << body.size () << "\r\n";
+  oss << "\r\n" << body;
+
+  if (! Send (oss.str ()))
+  {
+    Close ();
+    return false;
+  }
+
+  // Status line.
+  string line;
+  if (! ReadLine (&line))
+  {
+    Close ();
+    return false;
+  }
+
+  istringstream iss (line); string protocol;
+  if (! (iss >> protocol >> m_status))
+  {
+    Close ();
+    return false;
+  }
+
+  // HTTP/1.1 defaults to keep-alive, HTTP/1.0 doesn't.
+  m_keep_alive = (protocol == "HTTP/1.1");
+
+  // Headers.
+  bool length = false;
+  while (ReadLine (&line) && ! line.empty ())
+  {
+    size_t colon = line.find (':');
+    if (colon == string::npos) continue;
+
+    string name  = http_trim (line.substr (0, colon));
+    string value = http_trim (line.substr (colon + 1));
+
+    if (http_equals (name, "Content-Length"))
+    {
+      m_remaining = strtoull (value.c_str (), NULL, 10);
+      length = true;
+    }
+    else if (http_equals (name, "Transfer-Encoding"))
+      m_chunked = http_equals (value, "chunked");
+    else if (http_equals (name, "Connection"))
+      m_keep_alive = ! http_equals (value, "close");
+    else if (http_equals (name, "Content-Encoding"))
+      m_encoded = http_equals (value, "gzip") || http_equals (value, "deflate");
+
+    m_headers.emplace_back (name, value);
+  }
+
+  if (! line.empty ())
+  {
+    Close ();
+    return false;
+  }
+
+  if (m_encoded)
+  {
+    // zlib or gzip header, detected automatically.
+    m_zstream = z_stream ();
+    if (inflateInit2 (&m_zstream, 15 + 32) != Z_OK)
+    {
+      m_encoded = false;
+      Close ();
+      return false;
+    }
+  }
+
+  if (m_chunked)
+    return ReadChunk ();
+
+  if (! length)
+  {
+    // Body delimited by the end of the connection.
+    m_until_close = (method != "HEAD" && m_status != 204 && m_status != 304);
+    m_keep_alive  = false;
+    m_eof         = ! m_until_close;
+  }
+  else
+    m_eof = (m_remaining == 0);
+
+  return true;
+}
+
+string HTTPConnection::Header (const string & name) const
+{
+  for (auto & h : m_headers)
+    if (http_equals (h.first, name))
+      return h.second;
+
+  return "";
+}
+
+ssize_t HTTPConnection::Read (char * buffer, size_t size)
+{
+  if (! m_encoded)
+  {
+    ssize_t n = ReadBody (buffer, size);
+    if (n > 0) m_decoded += n;
+    return n;
+  }
+
+  m_zstream.next_out  = (Bytef *) buffer;
+  m_zstream.avail_out = (uInt) size;
+
+  while (m_zstream.avail_out == size)
+  {
+    if (m_zstream.avail_in == 0)
+    {
+      ssize_t n = ReadBody (m_zbuffer, sizeof (m_zbuffer));
+      if (n <= 0) return n;
+      m_zstream.next_in  = (Bytef *) m_zbuffer;
+      m_zstream.avail_in = (uInt) n;
+    }
+
+    int r = inflate (&m_zstream, Z_NO_FLUSH);
+    if (r == Z_STREAM_END)
+    {
+      // Skip whatever follows (the connection must be left clean).
+      EndInflate ();
+      for (char b [256]; ReadBody (b, sizeof (b)) > 0;);
+      break;
+    }
+
+    if (r != Z_OK && r != Z_BUF_ERROR)
+    {
+      EndInflate ();
+      Close ();
+      return -1;
+    }
+  }
+
+  ssize_t n = size - m_zstream.avail_out;
+  m_decoded += n;
+  return n;
+}
+
+ssize_t HTTPConnection::ReadBody (char * buffer, size_t size)
+{
+  if (m_eof || size == 0) return 0;
+
+  if (m_until_close)
+  {
+    // Unknown length: until the server hangs up.
+    ssize_t n = Receive (buffer, size);
+    if (n <= 0)
+    {
+      m_eof = true;
+      Close ();
+      return n;
+    }
+    m_wire += n;
+    return n;
+  }
+
+  // Whatever is available (never past the body, nor the current chunk).
+  ssize_t n = Receive (buffer, (size_t) min<uint64_t> (size, m_remaining));
+  if (n <= 0)
+  {
+    Close ();
+    return -1;
+  }
+
+  m_remaining -= n;
+  m_wire      += n;
+  m_last = time (NULL);
+
+  if (m_remaining == 0)
+  {
+    if (m_chunked)
+    {
+      // CRLF + next chunk size.
+      string line;
+      if (! ReadLine (&line) || ! ReadChunk ())
+      {
+        Close ();
+        return -1;
+      }
+    }
+    else
+      m_eof = true;
+  }
+
+  return n;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// S T R E A M /////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+HTTPStream::HTTPStream (const Source & source) :
+  m_source (source),
+  m_current (m_buffer),
+  m_end (m_buffer),
+  m_count (0)
+{
+  Fill ();
+}
+
+void HTTPStream::Fill ()
+{
+  m_count  += m_end - m_buffer;
+  ssize_t n = m_source (m_buffer, sizeof (m_buffer));
+  m_current = m_buffer;
+  m_end     = m_buffer + max<ssize_t> (n, 0);
+}
+
+HTTPStream::Ch HTTPStream::Take ()
+{
+  if (m_current == m_end) return '\0';
+  Ch c = *m_current++;
+  if (m_current == m_end) Fill ();
+  return c;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// L I M I T E R ///////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+HTTPLimiter::HTTPLimiter (double rate, double min, double max, double burst) :
+  m_mutex (),
+  m_event (false),
+  m_rate (rate),
+  m_min (min),
+  m_max (max),
+  m_burst (burst),
+  m_tokens (burst),
+  m_last (P8PLATFORM::GetTimeMs ()),
+  m_latency (0),
+  m_aborted (false)
+{
+}
+
+void HTTPLimiter::Refill ()
+{
+  int64_t now = P8PLATFORM::GetTimeMs ();
+  m_tokens = min (m_burst, m_tokens + (now - m_last) * m_rate / 1000);
+  m_last   = now;
+}
+
+void HTTPLimiter::Decrease ()
+{
+  m_rate = max (m_min, m_rate / 2);
+}
+
+bool HTTPLimiter::Acquire ()
+{
+  int64_t wait = 0;
+
+  {
+    P8PLATFORM::CLockObject lock (m_mutex);
+    if (m_aborted) return false;
+
+    Refill ();
+    m_tokens -= 1;
+    if (m_tokens < 0)
+      wait = (int64_t) (-m_tokens * 1000 / m_rate);
+  }
+
+  if (wait > 0)
+    m_event.Wait ((uint32_t) wait);
+
+  P8PLATFORM::CLockObject lock (m_mutex);
+  return ! m_aborted;
+}
+
+void HTTPLimiter::Success (int64_t latency)
+{
+  P8PLATFORM::CLockObject lock (m_mutex);
+
+  // Latency twice as high as usual: the server is struggling.
+  if (m_latency > 0 && latency > 2 * m_latency + 50)
+    Decrease ();
+  else
+    m_rate = min (m_max, m_rate + 0.25);
+
+  m_latency = m_latency > 0 ? 0.8 * m_latency + 0.2 * latency : latency;
+}
+
+void HTTPLimiter::Failure ()
+{
+  P8PLATFORM::CLockObject lock (m_mutex);
+  Decrease ();
+}
+
+void HTTPLimiter::SetMinimum (double min)
+{
+  P8PLATFORM::CLockObject lock (m_mutex);
+  m_min  = min;
+  m_rate = max (m_min, m_rate);
+}
+
+double HTTPLimiter::Rate () const
+{
+  P8PLATFORM::CLockObject lock (m_mutex);
+  return m_rate;
+}
+
+void HTTPLimiter::Abort ()
+{
+  {
+    P8PLATFORM::CLockObject lock (m_mutex);
+    m_aborted = true;
+  }
+
+  m_event.Broadcast ();
+}
+
+void HTTPLimiter::Resume ()
+{
+  P8PLATFORM::CLockObject lock (m_mutex);
+  Refill ();
+  m_tokens  = max (m_tokens, 1.0);
+  m_aborted = false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// P O O L /////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////
+
+HTTPPool::HTTPPool (const string & host, uint16_t port, size_t size, int idle, uint64_t timeout) :
+  m_mutex (),
+  m_host (host),
+  m_port (port),
+  m_size (size),
+  m_idle (idle),
+  m_timeout (timeout),
+  m_connections (),
+  m_wire (0),
+  m_decoded (0)
+{
+}
+
+void HTTPPool::Expire ()
+{
+  time_t now = time (NULL);
+  m_connections.erase (remove_if (m_connections.begin (), m_connections.end (),
+    [now, idle = m_idle] (const Connection & c) {return now - c->LastUsed () >= idle;}),
+    m_connections.end ());
+}
+
+HTTPPool::Connection HTTPPool::Acquire (bool * reused, bool fresh)
+{
+  if (! fresh)
+  {
+    P8PLATFORM::CLockObject lock (m_mutex);
+    Expire ();
+
+    if (! m_connections.empty ())
+    {
+      // Most recently used first: least likely to have been closed by the server.
+      Connection c = move (m_connections.back ());
+      m_connections.pop_back ();
+      if (reused) *reused = true;
+      return c;
+    }
+  }
+
+  if (reused) *reused = false;
+
+  Connection c (new HTTPConnection (m_host, m_port, m_timeout));
+  return c->Open () ? move (c) : Connection ();
+}
+
+void HTTPPool::Release (Connection c)
+{
+  if (! c) return;
+
+  P8PLATFORM::CLockObject lock (m_mutex);
+  m_wire    += c->Wire ();
+  m_decoded += c->Decoded ();
+
+  if (c->IsReusable () && c->IsOpen () && m_idle > 0 && m_connections.size () < m_size)
+    m_connections.push_back (move (c));
+}
+
+void HTTPPool::Statistics (uint64_t * wire, uint64_t * decoded) const
+{
+  P8PLATFORM::CLockObject lock (m_mutex);
+  if (wire)    *wire    = m_wire;
+  if (decoded) *decoded = m_decoded;
+}
+
+void HTTPPool::SetSize (size_t size)
+{
+  P8PLATFORM::CLockObject lock (m_mutex);
+  m_size = size;
+  if (m_connections.size () > m_size)
+    m_connections.erase (m_connections.begin (), m_connections.end () - m_size);
+}
+
+void HTTPPool::SetIdle (int idle)
+{
+  P8PLATFORM::CLockObject lock (m_mutex);
+  m_idle = idle;
+  Expire ();
+}
+
+void HTTPPool::Clear ()
+{
+  P8PLATFORM::CLockObject lock (m_mutex);
+  m_connections.clear ();
+}
+
@@ -0,0 +1,235 @@
+#pragma once
+/*
+ *      Copyright (C) 2018 Aassif Benassarou
+ *      http://github.com/aassif/pvr.freebox/
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <ctime>
+#include "p8-platform/os.h"
+#include "p8-platform/threads/mutex.h"
+#include "zlib.h"
+
+// TCP socket (non-blocking, with timeouts): reads return whatever is
+// available, so that responses can be read ahead into a buffer.
+class HTTPSocket
+{
+  private:
+    std::string m_host;
+    uint16_t    m_port;
+    intptr_t    m_fd;   // -1 = closed
+
+  public:
+    HTTPSocket (const std::string & host, uint16_t port);
+    ~HTTPSocket ();
+
+    bool Open   (uint64_t timeout);
+    void Close  ();
+    bool IsOpen () const {return m_fd != -1;}
+
+    // All bytes, or false.
+    bool    Write (const char *, size_t, uint64_t timeout);
+    // At least one byte: 0 if closed by the peer, -1 on error or timeout.
+    ssize_t Read  (char *, size_t, uint64_t timeout);
+};
+
+// HTTP/1.1 connection, kept alive between requests.
+class HTTPConnection
+{
+  public:
+    typedef std::vector<std::pair<std::string, std::string>> Headers;
+
+  private:
+    HTTPSocket  m_socket;
+    std::string m_host;
+    uint64_t    m_timeout;   // ms
+    time_t      m_last;      // last use
+    // Response.
+    int         m_status;
+    Headers     m_headers;
+    bool        m_keep_alive;
+    bool        m_chunked;
+    bool        m_until_close;
+    bool        m_eof;
+    uint64_t    m_remaining; // bytes left (body or current chunk)
+    // Content-Encoding (gzip, deflate).
+    bool        m_encoded;
+    z_stream    m_zstream;
+    char        m_zbuffer [4096];
+    // Received, not consumed yet.
+    char        m_buffer [16384];
+    size_t      m_begin;
+    size_t      m_end;
+    // Statistics (current response).
+    uint64_t    m_wire;
+    uint64_t    m_decoded;
+
+  protected:
+    bool    Send      (const std::string &);
+    // Bytes from the buffer first, then from the socket (at least one: 0 = closed, -1 = error).
+    ssize_t Receive   (char * buffer, size_t size);
+    bool    ReadLine  (std::string *);
+    bool    ReadChunk ();
+    // Body, as sent by the server.
+    ssize_t ReadBody  (char * buffer, size_t size);
+    void    EndInflate ();
+
+  public:
+    HTTPConnection (const std::string & host, uint16_t port, uint64_t timeout);
+    ~HTTPConnection ();
+
+    bool Open  ();
+    void Close ();
+    bool IsOpen () const;
+
+    // Sends a request, then reads status line and headers.
+    bool Request (const std::string & method,
+                  const std::string & path,
+                  const Headers &,
+                  const std::string & body);
+
+    int         Status () const {return m_status;}
+    std::string Header (const std::string & name) const;
+
+    // Reads (part of) the decoded body: 0 at the end, -1 on error.
+    ssize_t Read (char * buffer, size_t size);
+
+    // Body size: on the wire / decoded.
+    uint64_t Wire    () const {return m_wire;}
+    uint64_t Decoded () const {return m_decoded;}
+
+    // Can this connection serve another request?
+    bool IsReusable () const {return m_eof && m_keep_alive;}
+    time_t LastUsed () const {return m_last;}
+};
+
+// Input stream (as in rapidjson) pulling a response body through a buffer.
+class HTTPStream
+{
+  public:
+    typedef char Ch;
+    typedef std::function<ssize_t (char *, size_t)> Source;
+
+  private:
+    Source m_source;
+    char   m_buffer [4096];
+    char * m_current;
+    char * m_end;
+    size_t m_count;
+
+  protected:
+    void Fill ();
+
+  public:
+    HTTPStream (const Source &);
+
+    Ch     Peek () const {return m_current < m_end ? *m_current : '\0';}
+    Ch     Take ();
+    size_t Tell () const {return m_count + (m_current - m_buffer);}
+
+    // Write API (unused).
+    Ch *   PutBegin ()     {return nullptr;}
+    void   Put (Ch)        {}
+    void   Flush ()        {}
+    size_t PutEnd (Ch *)   {return 0;}
+};
+
+// Adaptive token bucket: the rate grows additively while responses are fast
+// and successful, and is cut down multiplicatively on errors, timeouts or
+// rising latency (AIMD).
+class HTTPLimiter
+{
+  private:
+    mutable P8PLATFORM::CMutex m_mutex;
+    P8PLATFORM::CEvent m_event;
+    double  m_rate;    // tokens per second
+    double  m_min;
+    double  m_max;
+    double  m_burst;   // bucket capacity
+    double  m_tokens;  // negative = reserved ahead
+    int64_t m_last;    // last refill (ms)
+    double  m_latency; // average latency (ms)
+    bool    m_aborted;
+
+  protected:
+    // NOT thread-safe !
+    void Refill ();
+    void Decrease ();
+
+  public:
+    HTTPLimiter (double rate, double min, double max, double burst);
+
+    // Waits for a token (false if aborted).
+    bool Acquire ();
+
+    // Feedback.
+    void Success (int64_t latency);
+    void Failure ();
+
+    // Slowest rate allowed (tokens per second).
+    void SetMinimum (double);
+    double Rate () const;
+
+    // Wakes up waiting threads, for good (until Resume ()).
+    void Abort ();
+    // Lets queries through again, the next one right away.
+    void Resume ();
+};
+
+// Pool of idle connections to a single host.
+class HTTPPool
+{
+  public:
+    typedef std::unique_ptr<HTTPConnection> Connection;
+
+  private:
+    mutable P8PLATFORM::CMutex m_mutex;
+    std::string             m_host;
+    uint16_t                m_port;
+    size_t                  m_size;    // max idle connections
+    int                     m_idle;    // idle timeout (s)
+    uint64_t                m_timeout; // I/O timeout (ms)
+    std::vector<Connection> m_connections;
+    // Statistics.
+    uint64_t                m_wire;
+    uint64_t                m_decoded;
+
+  protected:
+    // NOT thread-safe !
+    void Expire ();
+
+  public:
+    HTTPPool (const std::string & host, uint16_t port, size_t size, int idle, uint64_t timeout = 10000);
+
+    // Idle connection if any, new one otherwise.
+    Connection Acquire (bool * reused, bool fresh = false);
+    // Back to the pool (if still usable).
+    void Release (Connection);
+
+    // Bytes received on the wire / after decoding.
+    void Statistics (uint64_t * wire, uint64_t * decoded) const;
+
+    void SetSize (size_t);
+    void SetIdle (int);
+    void Clear ();
+};
+
@@ -0,0 +1,275 @@
+/*
+ *      Copyright (C) 2018 Aassif Benassarou
+ *      http://github.com/aassif/pvr.freebox/
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+#include <cstring>
+#include <cstdio>
+#include "p8-platform/util/timeutils.h"
+#include "Health.h"
+
+#ifdef TARGET_WINDOWS
+  #include <windows.h>
+#endif
+
+using namespace std;
+
+#define PVR_FREEBOX_HEALTH_MAGIC   0x53584246 // "FBXS"
+#define PVR_FREEBOX_HEALTH_VERSION 1
+
+// Zapping back within this delay: the stream did not work (ms).
+#define PVR_FREEBOX_HEALTH_REZAP    10000
+// Acceptable start latency (ms).
+#define PVR_FREEBOX_HEALTH_LATENCY  2000
+// Outcomes kept (older ones weigh half as much, then less).
+#define PVR_FREEBOX_HEALTH_WINDOW   32
+// First sign of playback later than this: not a start latency (ms).
+#define PVR_FREEBOX_HEALTH_TIMEOUT  15000
+// Penalty half-life (s).
+#define PVR_FREEBOX_HEALTH_HALFLIFE (6 * 60 * 60)
+// Penalties older than this are forgotten (s).
+#define PVR_FREEBOX_HEALTH_EXPIRY   (4 * PVR_FREEBOX_HEALTH_HALFLIFE)
+// Demoted below this factor.
+#define PVR_FREEBOX_HEALTH_DEMOTED  0.75
+
+StreamHealth::StreamHealth (const string & path) :
+  m_mutex (),
+  m_path (path),
+  m_records (),
+  m_penalized (),
+  m_channel (0),
+  m_url (),
+  m_zapped (0),
+  m_playing (false),
+  m_dirty (false)
+{
+}
+
+bool StreamHealth::Load ()
+{
+  P8PLATFORM::CLockObject lock (m_mutex);
+
+  ifstream ifs (m_path, ios::binary);
+  string data ((istreambuf_iterator<char> (ifs)), istreambuf_iterator<char> ());
+
+  size_t offset = 0;
+  auto read = [&data, &offset] (void * p, size_t n) -> bool
+  {
+    if (offset + n > data.size ()) return false;
+    memcpy (p, data.data () + offset, n);
+    offset += n;
+    return true;
+  };
+
+  uint32_t magic, version, count;
+  if (! read (&magic, 4) || magic   != PVR_FREEBOX_HEALTH_MAGIC
+   || ! read (&version, 4) || version != PVR_FREEBOX_HEALTH_VERSION
+   || ! read (&count, 4))
+    return false;
+
+  int64_t now = time (NULL);
+  map<string, Record>       records;
+  map<unsigned int, int64_t> penalized;
+  for (uint32_t i = 0; i < count; ++i)
+  {
+    uint32_t n;
+    Record   r;
+    if (! read (&n, 4) || offset + n > data.size ()) return false;
+    string url = data.substr (offset, n);
+    offset += n;
+    if (! read (&r, sizeof (Record))) return false;
+    records.emplace (url, r);
+    if ((r.failures > 0 || r.latency > PVR_FREEBOX_HEALTH_LATENCY) && now - r.updated < PVR_FREEBOX_HEALTH_EXPIRY)
+    {
+      int64_t & t = penalized [r.channel];
+      t = max (t, r.updated);
+    }
+  }
+
+  m_records   = move (records);
+  m_penalized = move (penalized);
+  m_dirty     = false;
+  return true;
+}
+
+bool StreamHealth::Save ()
+{
+  P8PLATFORM::CLockObject lock (m_mutex);
+  if (! m_dirty) return true;
+
+  // Expired penalties.
+  int64_t now = time (NULL);
+  for (auto i = m_penalized.begin (); i != m_penalized.end ();)
+    if (now - i->second >= PVR_FREEBOX_HEALTH_EXPIRY)
+      i = m_penalized.erase (i);
+    else
+      ++i;
+
+  string data;
+  auto write = [&data] (const void * p, size_t n) {data.append ((const char *) p, n);};
+
+  uint32_t magic = PVR_FREEBOX_HEALTH_MAGIC, version = PVR_FREEBOX_HEALTH_VERSION, count = m_records.size ();
+  write (&magic, 4);
+  write (&version, 4);
+  write (&count, 4);
+  for (auto & i : m_records)
+  {
+    uint32_t n = i.first.size ();
+    write (&n, 4);
+    write (i.first.data (), n);
+    write (&i.second, sizeof (Record));
+  }
+
+  // Replaced atomically: a crash while writing keeps the old history.
+  string tmp = m_path + ".tmp";
+  {
+    ofstream ofs (tmp, ios::binary | ios::trunc);
+    ofs.write (data.data (), data.size ());
+    ofs.close ();
+    if (! ofs)
+    {
+      remove (tmp.c_str ());
+      return false;
+    }
+  }
+
+#ifdef TARGET_WINDOWS
+  if (! MoveFileExA (tmp.c_str (), m_path.c_str (), MOVEFILE_REPLACE_EXISTING))
+#else
+  if (rename (tmp.c_str (), m_path.c_str ()) != 0)
+#endif
+  {
+    remove (tmp.c_str ());
+    return false;
+  }
+
+  m_dirty = false;
+  return true;
+}
+
+void StreamHealth::Penalize (const string & url)
+{
+  auto f = m_records.find (url);
+  if (f == m_records.end ()) return;
+
+  f->second.failures += 1;
+  f->second.updated   = time (NULL);
+  m_penalized [f->second.channel] = f->second.updated;
+  m_dirty = true;
+}
+
+void StreamHealth::Zap (unsigned int channel, const string & url)
+{
+  P8PLATFORM::CLockObject lock (m_mutex);
+  int64_t now = P8PLATFORM::GetTimeMs ();
+
+  // Same channel again, so soon (and never played): the last stream did not work.
+  if (m_zapped != 0 && ! m_playing && channel == m_channel && now - m_zapped < PVR_FREEBOX_HEALTH_REZAP)
+    Penalize (m_url);
+
+  Record & r = m_records.emplace (url, Record {channel, 0, 0, 0, 0}).first->second;
+  r.channel  = channel;
+  r.zaps    += 1;
+  r.updated  = time (NULL);
+  if (r.zaps > PVR_FREEBOX_HEALTH_WINDOW)
+  {
+    r.zaps     /= 2;
+    r.failures /= 2;
+  }
+
+  m_channel = channel;
+  m_url     = url;
+  m_zapped  = now;
+  m_playing = false;
+  m_dirty   = true;
+}
+
+void StreamHealth::Playing ()
+{
+  P8PLATFORM::CLockObject lock (m_mutex);
+  if (m_zapped == 0 || m_playing) return;
+  m_playing = true;
+
+  // Too late: whatever plays now may not be that stream.
+  int64_t latency = P8PLATFORM::GetTimeMs () - m_zapped;
+  if (latency > PVR_FREEBOX_HEALTH_TIMEOUT) return;
+
+  auto f = m_records.find (m_url);
+  if (f == m_records.end ()) return;
+
+  Record & r = f->second;
+  r.latency = r.latency != 0 ? (3 * r.latency + latency) / 4 : latency;
+  r.updated = time (NULL);
+  if (r.latency > PVR_FREEBOX_HEALTH_LATENCY)
+    m_penalized [r.channel] = r.updated;
+  m_dirty = true;
+}
+
+void StreamHealth::Cancel ()
+{
+  P8PLATFORM::CLockObject lock (m_mutex);
+  m_zapped  = 0;
+  m_playing = false;
+}
+
+// NOT thread-safe !
+double StreamHealth::Factor (const Record & r, int64_t now) const
+{
+  double reliability = 1.0 - (double) r.failures / (r.zaps + 1);
+  double speed       = r.latency > PVR_FREEBOX_HEALTH_LATENCY ? (double) PVR_FREEBOX_HEALTH_LATENCY / r.latency : 1.0;
+
+  // Old news: the stream deserves another chance.
+  double age  = max<double> (0.0, (double) (now - r.updated));
+  double fade = exp2 (-age / PVR_FREEBOX_HEALTH_HALFLIFE);
+  return max (0.01, 1.0 - (1.0 - reliability * speed) * fade);
+}
+
+double StreamHealth::Factor (const string & url) const
+{
+  P8PLATFORM::CLockObject lock (m_mutex);
+  auto f = m_records.find (url);
+  return f != m_records.end () ? Factor (f->second, time (NULL)) : 1.0;
+}
+
+bool StreamHealth::Demoted (const string & url) const
+{
+  return Factor (url) < PVR_FREEBOX_HEALTH_DEMOTED;
+}
+
+bool StreamHealth::Penalized (unsigned int channel) const
+{
+  P8PLATFORM::CLockObject lock (m_mutex);
+  auto f = m_penalized.find (channel);
+  if (f == m_penalized.end ()) return false;
+
+  // Faded out by now.
+  if (time (NULL) - f->second >= PVR_FREEBOX_HEALTH_EXPIRY)
+  {
+    m_penalized.erase (f);
+    return false;
+  }
+
+  return true;
+}
+
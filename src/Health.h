@@ -0,0 +1,81 @@
+#pragma once
+/*
+ *      Copyright (C) 2018 Aassif Benassarou
+ *      http://github.com/aassif/pvr.freebox/
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include <string>
+#include <map>
+#include <cstdint>
+#include "p8-platform/threads/mutex.h"
+
+// Stream outcomes (by URL), persisted: slow or flaky streams are demoted.
+// Zapping back to the same channel within seconds (before any sign of
+// playback) counts as a failure; start latency is measured up to the first
+// sign of playback, if it comes soon enough.
+class StreamHealth
+{
+  public:
+    struct Record
+    {
+      uint32_t channel;
+      uint32_t zaps;
+      uint32_t failures;
+      uint32_t latency;  // ms (moving average, 0 = unknown)
+      int64_t  updated;  // time
+    };
+
+  private:
+    mutable P8PLATFORM::CMutex m_mutex;
+    std::string m_path;
+    std::map<std::string, Record> m_records;
+    // Channels with a penalized stream (time of the last penalty).
+    mutable std::map<unsigned int, int64_t> m_penalized;
+    // Last zap.
+    unsigned int m_channel;
+    std::string  m_url;
+    int64_t      m_zapped;  // ms (0 = none)
+    bool         m_playing;
+    bool         m_dirty;
+
+  protected:
+    // NOT thread-safe !
+    void Penalize (const std::string & url);
+    double Factor (const Record &, int64_t now) const;
+
+  public:
+    StreamHealth (const std::string & path);
+
+    bool Load ();
+    bool Save ();
+
+    // Outcomes.
+    void Zap (unsigned int channel, const std::string & url);
+    void Playing ();
+    // Something else is played: the last zap is over.
+    void Cancel ();
+
+    // Health factor, in (0, 1] (penalties fade out within a day or so).
+    double Factor (const std::string & url) const;
+    // Too unhealthy: only used if no other stream is left.
+    bool Demoted (const std::string & url) const;
+    // Any recent penalty on this channel?
+    bool Penalized (unsigned int channel) const;
+};
+
@@ -0,0 +1,173 @@
+/*
+ *      Copyright (C) 2018 Aassif Benassarou
+ *      http://github.com/aassif/pvr.freebox/
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include <fstream>
+#include <iterator>
+#include <cstdio>
+#include "Prefs.h"
+
+#ifdef TARGET_WINDOWS
+  #include <windows.h>
+  #include <io.h>
+#else
+  #include <unistd.h>
+#endif
+
+using namespace std;
+
+// Journal lines allowed per live value before compaction (plus some slack).
+#define PVR_FREEBOX_PREFS_RATIO 4
+#define PVR_FREEBOX_PREFS_SLACK 64
+
+PrefsStore::PrefsStore (const string & path) :
+  m_mutex (),
+  m_event (),
+  m_path (path),
+  m_pending (),
+  m_values (),
+  m_lines (0)
+{
+}
+
+PrefsStore::~PrefsStore ()
+{
+  StopThread (-1);
+  m_event.Signal ();
+  StopThread ();
+
+  Flush ();
+}
+
+bool PrefsStore::Load (Values * result)
+{
+  ifstream ifs (m_path, ios::binary);
+  if (! ifs) return false;
+
+  string data ((istreambuf_iterator<char> (ifs)), istreambuf_iterator<char> ());
+
+  Values values;
+  size_t lines = 0;
+  // Complete lines only: the last one may have been cut short.
+  for (size_t p = 0, eol; (eol = data.find ('\n', p)) != string::npos; p = eol + 1, ++lines)
+  {
+    size_t tab = data.find ('\t', p);
+    if (tab == string::npos || tab > eol) continue;
+
+    string key   = data.substr (p, tab - p);
+    string value = data.substr (tab + 1, eol - tab - 1);
+    if (value.empty ())
+      values.erase (key);
+    else
+      values [key] = value;
+  }
+
+  m_values = values;
+  m_lines  = lines;
+
+  // Torn line: appending after it would corrupt the next one.
+  if (! data.empty () && data.back () != '\n')
+    Compact ();
+
+  *result = move (values);
+  return true;
+}
+
+void PrefsStore::Set (const string & key, const string & value)
+{
+  {
+    P8PLATFORM::CLockObject lock (m_mutex);
+    m_pending.emplace_back (key, value);
+  }
+
+  m_event.Signal ();
+}
+
+bool PrefsStore::Flush ()
+{
+  vector<pair<string, string>> pending;
+  {
+    P8PLATFORM::CLockObject lock (m_mutex);
+    pending.swap (m_pending);
+  }
+
+  if (pending.empty ()) return true;
+
+  string data;
+  for (auto & i : pending)
+  {
+    if (i.second.empty ())
+      m_values.erase (i.first);
+    else
+      m_values [i.first] = i.second;
+
+    data += i.first + '\t' + i.second + '\n';
+  }
+
+  // Journal too long: a fresh file (or a plain append, if that fails).
+  if (m_lines + pending.size () > PVR_FREEBOX_PREFS_RATIO * m_values.size () + PVR_FREEBOX_PREFS_SLACK)
+    if (Compact ()) return true;
+
+  ofstream ofs (m_path, ios::binary | ios::app);
+  ofs.write (data.data (), data.size ());
+  ofs.flush ();
+  m_lines += pending.size ();
+  return (bool) ofs;
+}
+
+bool PrefsStore::Compact ()
+{
+  string data;
+  for (auto & i : m_values)
+    data += i.first + '\t' + i.second + '\n';
+
+  // On disk (not only in the page cache) before it replaces the journal.
+  string tmp = m_path + ".tmp";
+  FILE * f = fopen (tmp.c_str (), "wb");
+  if (! f) return false;
+  bool written = fwrite (data.data (), 1, data.size (), f) == data.size () && fflush (f) == 0;
+#ifdef TARGET_WINDOWS
+  written = written && _commit (_fileno (f)) == 0;
+#else
+  written = written && fsync (fileno (f)) == 0;
+#endif
+  if (fclose (f) != 0 || ! written) return false;
+
+#ifdef TARGET_WINDOWS
+  bool renamed = MoveFileExA (tmp.c_str (), m_path.c_str (), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+  bool renamed = rename (tmp.c_str (), m_path.c_str ()) == 0;
+#endif
+
+  if (renamed) m_lines = m_values.size ();
+  return renamed;
+}
+
+void * PrefsStore::Process ()
+{
+  while (! IsStopped ())
+  {
+    m_event.Wait (1000);
+    Flush ();
+  }
+
+  return NULL;
+}
+
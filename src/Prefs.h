@@ -0,0 +1,67 @@
+#pragma once
+/*
+ *      Copyright (C) 2018 Aassif Benassarou
+ *      http://github.com/aassif/pvr.freebox/
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>
+#include "p8-platform/threads/mutex.h"
+#include "p8-platform/threads/threads.h"
+
+// Preferences (key -> value), journaled: changes are queued, then appended
+// to the file by a background writer (one "key\tvalue" line each, an empty
+// value erases the key). The journal is compacted into a fresh file
+// (atomic rename) when it gets too long. A torn last line is ignored.
+class PrefsStore :
+  public P8PLATFORM::CThread
+{
+  public:
+    typedef std::map<std::string, std::string> Values;
+
+  private:
+    // Queued changes only.
+    P8PLATFORM::CMutex m_mutex;
+    P8PLATFORM::CEvent m_event;
+    std::string m_path;
+    std::vector<std::pair<std::string, std::string>> m_pending;
+    // Writer thread only (or before it starts, after it stops).
+    Values m_values;
+    size_t m_lines;
+
+  protected:
+    // NOT thread-safe !
+    bool Flush ();
+    bool Compact ();
+
+  public:
+    PrefsStore (const std::string & path);
+    // Stops the writer, then flushes.
+    virtual ~PrefsStore ();
+
+    // Replays the journal (before CreateThread ()): false if there is none.
+    bool Load (Values *);
+    // Queued: never waits for the disk.
+    void Set (const std::string & key, const std::string & value);
+
+    virtual void * Process ();
+};
+
@@ -37,14 +37,19 @@ using namespace ADDON;
 #endif
 
 std::string  path;
-int          delay    = 0;
-int          source   = 1;
-int          quality  = 1;
-bool         extended = false;
-bool         colors   = false;
-bool         init     = false;
-ADDON_STATUS status   = ADDON_STATUS_UNKNOWN;
-Freebox    * data     = nullptr;
+int          delay       = 0;
+int          connections = 4;
+int          keepalive   = 30;
+int          workers     = 2;
+int          source      = 1;
+int          quality     = 1;
+bool         extended    = false;
+int          window      = 6;
+int          budget      = 32;
+bool         colors      = false;
+bool         init        = false;
+ADDON_STATUS status      = ADDON_STATUS_UNKNOWN;
+Freebox    * data        = nullptr;
 
 CHelper_libXBMC_addon  * XBMC = nullptr;
 CHelper_libXBMC_pvr    * PVR  = nullptr;
@@ -54,11 +59,16 @@ extern "C" {
 
 void ADDON_ReadSettings ()
 {
-  if (! XBMC->GetSetting ("delay",    &delay))    delay    = 0;
-  if (! XBMC->GetSetting ("source",   &source))   source   = 1;
-  if (! XBMC->GetSetting ("quality",  &quality))  quality  = 1;
-  if (! XBMC->GetSetting ("extended", &extended)) extended = false;
-  if (! XBMC->GetSetting ("colors",   &colors))   colors   = false;
+  if (! XBMC->GetSetting ("delay",       &delay))       delay       = 0;
+  if (! XBMC->GetSetting ("connections", &connections)) connections = 4;
+  if (! XBMC->GetSetting ("keepalive",   &keepalive))   keepalive   = 30;
+  if (! XBMC->GetSetting ("workers",     &workers))     workers     = 2;
+  if (! XBMC->GetSetting ("source",      &source))      source      = 1;
+  if (! XBMC->GetSetting ("quality",     &quality))     quality     = 1;
+  if (! XBMC->GetSetting ("extended",    &extended))    extended    = false;
+  if (! XBMC->GetSetting ("window",      &window))      window      = 6;
+  if (! XBMC->GetSetting ("budget",      &budget))      budget      = 32;
+  if (! XBMC->GetSetting ("colors",      &colors))      colors      = false;
 }
 
 ADDON_STATUS ADDON_Create (void * callbacks, void * properties)
@@ -106,13 +116,15 @@ ADDON_STATUS ADDON_Create (void * callbacks, void * properties)
   static std::vector<PVR_MENUHOOK> HOOKS =
   {
     {PVR_FREEBOX_MENUHOOK_CHANNEL_SOURCE,  PVR_FREEBOX_STRING_CHANNEL_SOURCE,  PVR_MENUHOOK_CHANNEL},
-    {PVR_FREEBOX_MENUHOOK_CHANNEL_QUALITY, PVR_FREEBOX_STRING_CHANNEL_QUALITY, PVR_MENUHOOK_CHANNEL}
+    {PVR_FREEBOX_MENUHOOK_CHANNEL_QUALITY, PVR_FREEBOX_STRING_CHANNEL_QUALITY, PVR_MENUHOOK_CHANNEL},
+    {PVR_FREEBOX_MENUHOOK_EPG_DETAILS,     PVR_FREEBOX_STRING_EPG_DETAILS,     PVR_MENUHOOK_EPG}
   };
 
   for (PVR_MENUHOOK & h : HOOKS)
     PVR->AddMenuHook (&h);
 
-  data   = new Freebox (p->strUserPath, source, quality, p->iEpgMaxDays, extended, colors, delay);
+  data   = new Freebox (p->strUserPath, source, quality, p->iEpgMaxDays, extended, window, budget, colors, delay, connections, keepalive, workers);
+  data->Start ();
   status = ADDON_STATUS_OK;
   init   = true;
 
@@ -138,6 +150,12 @@ ADDON_STATUS ADDON_SetSetting (const char * name, const void * value)
     if (! strcmp (name, "delay"))
       data->SetDelay (*((int *) value));
 
+    if (! strcmp (name, "connections"))
+      data->SetConnections (*((int *) value));
+
+    if (! strcmp (name, "keepalive"))
+      data->SetKeepAlive (*((int *) value));
+
     if (! strcmp (name, "restart"))
     {
       bool restart = *((bool *) value);
@@ -153,11 +171,20 @@ ADDON_STATUS ADDON_SetSetting (const char * name, const void * value)
     if (! strcmp (name, "extended"))
       data->SetExtended (*((bool *) value));
 
+    if (! strcmp (name, "window"))
+      data->SetWindow (*((int *) value));
+
+    if (! strcmp (name, "budget"))
+      data->SetBudget (*((int *) value));
+
     if (! strcmp (name, "colors"))
     {
       data->SetColors (*((bool *) value));
       return ADDON_STATUS_NEED_RESTART;
     }
+
+    if (! strcmp (name, "workers"))
+      return ADDON_STATUS_NEED_RESTART;
   }
 
   return ADDON_STATUS_OK;
@@ -237,7 +264,7 @@ PVR_ERROR SetEPGTimeFrame (int days)
 
 PVR_ERROR GetEPGForChannel (ADDON_HANDLE handle, int id, time_t start, time_t end)
 {
-  return PVR_ERROR_NO_ERROR;
+  return data ? data->GetEPGForChannel (handle, id, start, end) : PVR_ERROR_SERVER_ERROR;
 }
 
 int GetChannelsAmount ()
@@ -326,7 +353,12 @@ PVR_ERROR DeleteTimer (const PVR_TIMER & timer, bool force)
 }
 
 PVR_ERROR GetDriveSpace (long long *, long long *) {return PVR_ERROR_NOT_IMPLEMENTED;}
-PVR_ERROR SignalStatus (PVR_SIGNAL_STATUS &) {return PVR_ERROR_NOT_IMPLEMENTED;}
+PVR_ERROR SignalStatus (PVR_SIGNAL_STATUS &)
+{
+  // Polled by Kodi while a channel is playing: the stream did start.
+  if (data) data->StreamStarted ();
+  return PVR_ERROR_NOT_IMPLEMENTED;
+}
 
 PVR_ERROR CallMenuHook (const PVR_MENUHOOK & hook, const PVR_MENUHOOK_DATA & d)
 {
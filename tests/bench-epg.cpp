@@ -0,0 +1,160 @@
+/*
+ *      Copyright (C) 2018 Aassif Benassarou
+ *      http://github.com/aassif/pvr.freebox/
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include <iostream>
+#include <sstream>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <filesystem>
+#include "Freebox.h"
+
+using namespace std;
+using namespace rapidjson;
+
+// EPG events, from the parsed document to the EPG_TAG handed to Kodi
+// (ParseEvent, then TransferEntry): no heap allocation per event once
+// warmed up.
+
+#define BENCH_CHANNELS 300
+#define BENCH_DAYS     7
+#define BENCH_EVENTS   32 // per channel and day
+
+static size_t bench_allocs = 0;
+
+void * operator new (size_t size)
+{
+  void * p = malloc (size);
+  if (! p) throw bad_alloc ();
+  ++bench_allocs;
+  return p;
+}
+
+void operator delete (void * p) noexcept
+{
+  free (p);
+}
+
+void operator delete (void * p, size_t) noexcept
+{
+  free (p);
+}
+
+class Bench : public Freebox
+{
+  public:
+    Bench (const string & path);
+
+    static int Run ();
+};
+
+// Not started: no thread, no query.
+Bench::Bench (const string & path) :
+  //       path, source, quality, days, extended, window, budget, colors, delay, connections, keepalive, workers
+  Freebox (path, 0,      0,       7,    false,    6,      32,     false,  10,    1,           1,         1)
+{
+}
+
+// A week of programs, as sent by /api/v6/tv/epg/by_channel/*.
+static string bench_json ()
+{
+  ostringstream oss;
+  oss << '[';
+  for (int i = 0; i < BENCH_CHANNELS * BENCH_DAYS * BENCH_EVENTS; ++i)
+  {
+    oss << (i ? "," : "")
+        << "{\"id\":\"pluri_" << 1000000 + i << "\","
+        << "\"date\":" << 1600000000 + i * 2700 << ",\"duration\":2700,"
+        << "\"category\":" << 1 + i % 30 << ",\"season_number\":2,\"episode_number\":" << i % 24 << ",\"year\":2020,"
+        << "\"title\":\"Programme " << i << "\",\"sub_title\":\"Episode " << i % 24 << "\","
+        << "\"short_desc\":\"A short description, long enough to defeat small strings.\","
+        << "\"desc\":\"A longer description of the program, as found in the guide, with a few sentences in it.\","
+        << "\"picture_big\":\"/api/v6/tv/img/epg/" << i << ".jpg\","
+        << "\"cast\":["
+        << "{\"job\":\"Réalisateur\",\"first_name\":\"Jean\",\"last_name\":\"Dupont\"},"
+        << "{\"job\":\"Acteur\",\"first_name\":\"Marie\",\"last_name\":\"Martin\"},"
+        << "{\"job\":\"Acteur\",\"first_name\":\"Pierre\",\"last_name\":\"Durand\"},"
+        << "{\"job\":\"Scénariste\",\"first_name\":\"Paul\",\"last_name\":\"Bernard\"}]}";
+  }
+  oss << ']';
+  return oss.str ();
+}
+
+int Bench::Run ()
+{
+  string path = (filesystem::temp_directory_path () / "pvr.freebox-bench-epg").string () + '/';
+  filesystem::remove_all (path);
+  filesystem::create_directories (path);
+
+  Bench b (path);
+
+  Document d;
+  d.Parse (bench_json ().c_str ());
+  if (d.HasParseError () || ! d.IsArray ()) return 1;
+
+  size_t checksum = 0;
+  auto transfer = [&checksum] (EPG_TAG * tag) {checksum += tag->iUniqueBroadcastId + strlen (tag->strIconPath);};
+
+  // Warm-up: scratch buffers reach their size.
+  for (SizeType i = 0; i < d.Size (); ++i)
+    b.TransferEntry (ParseEvent (d[i], 1 + i % BENCH_CHANNELS, 0, false), transfer);
+
+  checksum = 0;
+  bench_allocs = 0;
+  auto start = chrono::steady_clock::now ();
+  for (SizeType i = 0; i < d.Size (); ++i)
+  {
+    EPGStore::View e = ParseEvent (d[i], 1 + i % BENCH_CHANNELS, 0, false);
+    // As in ProcessEvent (): a new std::function per event.
+    b.TransferEntry (e, [&checksum] (EPG_TAG * tag) {checksum += tag->iUniqueBroadcastId + strlen (tag->strIconPath);});
+  }
+  double ms = chrono::duration<double, milli> (chrono::steady_clock::now () - start).count ();
+  size_t allocs = bench_allocs;
+
+  cout << d.Size () << " events: " << ms << " ms, " << allocs << " allocations (checksum " << checksum << ')' << endl;
+
+  // Views into the document, cast in one pass.
+  EPGStore::View e = ParseEvent (d[0], 1, 0, false);
+  if (e.broadcast != 1000000 || e.start != 1600000000 || e.duration != 2700) return 1;
+  if (e.title != "Programme 0" || e.title.data () != d[0]["title"].GetString ()) return 1;
+  if (e.actors != string ("Marie Martin") + EPG_STRING_TOKEN_SEPARATOR + "Pierre Durand") return 1;
+  if (e.director != "Jean Dupont") return 1;
+  if (e.fingerprint == 0) return 1;
+
+  // The tag points into the document, the cast buffers and the picture buffer.
+  bool ok = false;
+  b.TransferEntry (e, [&] (EPG_TAG * tag)
+  {
+    ok = tag->iUniqueBroadcastId == 1000000
+      && tag->strTitle == d[0]["title"].GetString ()
+      && tag->strDirector == e.director.data ()
+      && string (tag->strIconPath) == "http://" + b.GetServer () + "/api/v6/tv/img/epg/0.jpg";
+  });
+  if (! ok) return 1;
+
+  return allocs == 0 ? 0 : 1;
+}
+
+int main ()
+{
+  return Bench::Run ();
+}
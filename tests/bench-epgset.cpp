@@ -0,0 +1,118 @@
+/*
+ *      Copyright (C) 2018 Aassif Benassarou
+ *      http://github.com/aassif/pvr.freebox/
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <set>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include "EPG.h"
+
+using namespace std;
+
+// EPG dedupe over a week-long guide: EPGSet (broadcast ids) versus the
+// former set of query strings. Every event is seen twice (overlapping slices).
+
+#define BENCH_CHANNELS 300
+#define BENCH_DAYS     7
+#define BENCH_EVENTS   32 // per channel and day
+
+// Live heap (bytes), for the footprint: containers free with a size.
+static size_t bench_heap = 0;
+
+void * operator new (size_t size)
+{
+  void * p = malloc (size);
+  if (! p) throw bad_alloc ();
+  bench_heap += size;
+  return p;
+}
+
+void operator delete (void * p) noexcept
+{
+  free (p);
+}
+
+void operator delete (void * p, size_t size) noexcept
+{
+  bench_heap -= size;
+  free (p);
+}
+
+template <typename F>
+double bench_ms (const F & f)
+{
+  auto start = chrono::steady_clock::now ();
+  f ();
+  return chrono::duration<double, milli> (chrono::steady_clock::now () - start).count ();
+}
+
+int main ()
+{
+  // Broadcast ids, in slice order (duplicates included).
+  mt19937 random (42);
+  vector<uint32_t> ids;
+  for (int i = 0; i < BENCH_CHANNELS * BENCH_DAYS * BENCH_EVENTS; ++i)
+    ids.push_back (1000000 + random () % 100000000);
+  vector<uint32_t> stream (ids);
+  stream.insert (stream.end (), ids.begin (), ids.end ());
+  shuffle (stream.begin (), stream.end (), random);
+
+  // Before: one string per lookup, one node per event.
+  size_t unique1 = 0;
+  size_t heap1   = bench_heap;
+  set<string> urls;
+  double ms1 = bench_ms ([&]
+  {
+    for (uint32_t id : stream)
+    {
+      string query = "/api/v6/tv/epg/programs/pluri_" + to_string (id);
+      if (urls.insert (query).second) ++unique1;
+    }
+  });
+  heap1 = bench_heap - heap1;
+
+  // After.
+  size_t unique2 = 0;
+  size_t heap2   = bench_heap;
+  EPGSet set;
+  double ms2 = bench_ms ([&]
+  {
+    for (uint32_t id : stream)
+      if (set.Insert (id)) ++unique2;
+  });
+  heap2 = bench_heap - heap2;
+
+  cout << stream.size () << " lookups, " << unique1 << " events" << endl;
+  cout << "set<string> : " << ms1 << " ms, " << heap1 / 1024 << " KiB" << endl;
+  cout << "EPGSet      : " << ms2 << " ms, " << heap2 / 1024 << " KiB" << endl;
+
+  // Same answers.
+  if (unique1 != unique2 || set.Size () != urls.size ()) return 1;
+  for (uint32_t id : ids)
+    if (! set.Contains (id)) return 1;
+  if (set.Contains (999999)) return 1;
+
+  return 0;
+}
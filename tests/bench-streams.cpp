@@ -0,0 +1,116 @@
+/*
+ *      Copyright (C) 2018 Aassif Benassarou
+ *      http://github.com/aassif/pvr.freebox/
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include <iostream>
+#include <random>
+#include <chrono>
+#include "Freebox.h"
+
+using namespace std;
+
+// Best stream per (source, quality), precomputed when a channel is built:
+// checked against the score tables, then timed on the zap path.
+
+#define BENCH_CHANNELS 200
+#define BENCH_ZAPS     1000000
+
+class Bench : public Freebox
+{
+  public:
+    static int Run ();
+};
+
+int Bench::Run ()
+{
+  static const Source  SOURCES   [] = {Source::IPTV, Source::DVB};
+  static const Quality QUALITIES [] = {Quality::HD, Quality::SD, Quality::LD, Quality::STEREO};
+
+  mt19937 random (42);
+  vector<Channel> channels;
+  for (int i = 1; i <= BENCH_CHANNELS; ++i)
+  {
+    vector<Stream> streams;
+    for (int n = random () % 6; n >= 0; --n)
+    {
+      string url = "rtsp://" + to_string (i) + '/' + to_string (streams.size ());
+      streams.emplace_back (SOURCES [random () % 2], QUALITIES [random () % 4], url);
+    }
+    channels.emplace_back ("uuid-webtv-" + to_string (i), "Channel", "", i, 0, streams);
+  }
+
+  StreamHealth health ("");
+
+  // Same as scoring every stream: first highest score.
+  for (const Channel & c : channels)
+    for (int s = 0; s < 3; ++s)
+      for (int q = 0; q < 5; ++q)
+      {
+        int expected = -1, score = 0;
+        for (size_t i = 0; i < c.streams.size (); ++i)
+        {
+          int x = c.streams[i].score (Source (s), Quality (q));
+          if (expected < 0 || x > score) {expected = i; score = x;}
+        }
+
+        if (c.BestStream (Source (s), Quality (q), health) != expected)
+        {
+          cerr << c.uuid << ": wrong stream for (" << s << ", " << q << ')' << endl;
+          return 1;
+        }
+      }
+
+  // One lookup per zap.
+  size_t checksum = 0;
+  auto start = chrono::steady_clock::now ();
+  for (int i = 0; i < BENCH_ZAPS; ++i)
+    checksum += channels [i % BENCH_CHANNELS].BestStream (Source (i % 3), Quality (i % 5), health);
+  double ns = chrono::duration<double, nano> (chrono::steady_clock::now () - start).count () / BENCH_ZAPS;
+  cout << "BestStream: " << ns << " ns per zap (checksum " << checksum << ')' << endl;
+
+  // A stream that fails (zapped again, never played) gives way to the next best.
+  const Channel * c = nullptr;
+  for (const Channel & x : channels)
+    if (x.streams.size () >= 2) {c = &x; break;}
+  if (! c) return 1;
+
+  unsigned int id = ChannelId (c->uuid);
+  int best = c->BestStream (Source::AUTO, Quality::AUTO, health);
+  health.Zap (id, c->streams[best].url);
+  health.Zap (id, c->streams[best].url);
+  if (! health.Penalized (id) || c->BestStream (Source::AUTO, Quality::AUTO, health) == best)
+  {
+    cerr << c->uuid << ": failing stream still preferred" << endl;
+    return 1;
+  }
+
+  start = chrono::steady_clock::now ();
+  for (int i = 0; i < BENCH_ZAPS; ++i)
+    checksum += c->BestStream (Source (i % 3), Quality (i % 5), health);
+  ns = chrono::duration<double, nano> (chrono::steady_clock::now () - start).count () / BENCH_ZAPS;
+  cout << "BestStream (penalized channel): " << ns << " ns per zap (checksum " << checksum << ')' << endl;
+
+  return 0;
+}
+
+int main ()
+{
+  return Bench::Run ();
+}
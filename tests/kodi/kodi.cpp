@@ -0,0 +1,31 @@
+/*
+ *      Copyright (C) 2018 Aassif Benassarou
+ *      http://github.com/aassif/pvr.freebox/
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include "client.h"
+
+// What ADDON_Create () would register (see src/client.cpp).
+static ADDON::CHelper_libXBMC_addon addon;
+static CHelper_libXBMC_pvr          pvr;
+static CHelper_libKODI_guilib       gui;
+
+ADDON::CHelper_libXBMC_addon * XBMC = &addon;
+CHelper_libXBMC_pvr          * PVR  = &pvr;
+CHelper_libKODI_guilib       * GUI  = &gui;
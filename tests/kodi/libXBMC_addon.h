@@ -0,0 +1,100 @@
+#pragma once
+/*
+ *      Copyright (C) 2018 Aassif Benassarou
+ *      http://github.com/aassif/pvr.freebox/
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+// Stand-in for Kodi's add-on helper (tests only): logs and notifications
+// are dropped, files are local, and Kodi's CURL is never available.
+
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include "p8-platform/os.h"
+
+typedef enum addon_log
+{
+  LOG_DEBUG,
+  LOG_INFO,
+  LOG_NOTICE,
+  LOG_ERROR
+} addon_log_t;
+
+typedef enum queue_msg
+{
+  QUEUE_INFO,
+  QUEUE_WARNING,
+  QUEUE_ERROR
+} queue_msg_t;
+
+namespace XFILE
+{
+  enum CURLOPTIONTYPE
+  {
+    CURL_OPTION_OPTION,
+    CURL_OPTION_PROTOCOL,
+    CURL_OPTION_CREDENTIALS,
+    CURL_OPTION_HEADER
+  };
+
+  enum FileProperty
+  {
+    FILE_PROPERTY_RESPONSE_PROTOCOL,
+    FILE_PROPERTY_RESPONSE_HEADER,
+    FILE_PROPERTY_CONTENT_TYPE,
+    FILE_PROPERTY_CONTENT_CHARSET,
+    FILE_PROPERTY_MIME_TYPE,
+    FILE_PROPERTY_EFFECTIVE_URL
+  };
+
+  enum
+  {
+    READ_TRUNCATED = 0x01,
+    READ_CHUNKED   = 0x02,
+    READ_CACHED    = 0x04,
+    READ_NO_CACHE  = 0x08
+  };
+}
+
+namespace ADDON
+{
+  class CHelper_libXBMC_addon
+  {
+    public:
+      bool RegisterMe (void *) {return true;}
+
+      void Log (const addon_log_t, const char *, ...) {}
+      void QueueNotification (const queue_msg_t, const char *, ...) {}
+
+      bool   GetSetting (const char *, void *) {return false;}
+      char * GetLocalizedString (int) {return strdup ("");}
+      void   FreeString (char * s) {free (s);}
+
+      bool FileExists      (const char * path, bool) {return std::filesystem::is_regular_file (path);}
+      bool DirectoryExists (const char * path)       {return std::filesystem::is_directory (path);}
+      bool CreateDirectory (const char * path)       {return std::filesystem::create_directories (path);}
+
+      void *  CURLCreate (const char *) {return nullptr;}
+      bool    CURLAddOption (void *, XFILE::CURLOPTIONTYPE, const char *, const char *) {return false;}
+      bool    CURLOpen (void *, unsigned int) {return false;}
+      ssize_t ReadFile (void *, void *, size_t) {return -1;}
+      void    CloseFile (void *) {}
+      char *  GetFilePropertyValue (void *, XFILE::FileProperty, const char *) {return nullptr;}
+  };
+}
@@ -0,0 +1,50 @@
+#pragma once
+/*
+ *      Copyright (C) 2018 Aassif Benassarou
+ *      http://github.com/aassif/pvr.freebox/
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+// Stand-in for Kodi's PVR helper (tests only): entries are counted.
+
+#include <atomic>
+#include "xbmc_pvr_types.h"
+
+class CHelper_libXBMC_pvr
+{
+  public:
+    std::atomic<unsigned int> channels   {0};
+    std::atomic<unsigned int> recordings {0};
+    std::atomic<unsigned int> timers     {0};
+    std::atomic<unsigned int> events     {0};
+
+  public:
+    bool RegisterMe (void *) {return true;}
+
+    void AddMenuHook (PVR_MENUHOOK *) {}
+
+    void TransferChannelEntry   (const ADDON_HANDLE, const PVR_CHANNEL *)   {++channels;}
+    void TransferRecordingEntry (const ADDON_HANDLE, const PVR_RECORDING *) {++recordings;}
+    void TransferTimerEntry     (const ADDON_HANDLE, const PVR_TIMER *)     {++timers;}
+    void TransferEpgEntry       (const ADDON_HANDLE, const EPG_TAG *)       {++events;}
+    void EpgEventStateChange    (EPG_TAG *, EPG_EVENT_STATE)                {++events;}
+
+    void TriggerChannelUpdate   () {}
+    void TriggerRecordingUpdate () {}
+    void TriggerTimerUpdate     () {}
+};
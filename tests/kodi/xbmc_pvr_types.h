@@ -0,0 +1,280 @@
+#pragma once
+/*
+ *      Copyright (C) 2018 Aassif Benassarou
+ *      http://github.com/aassif/pvr.freebox/
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+// Kodi PVR types, as far as the add-on uses them (tests only).
+
+#include <cstdint>
+#include <ctime>
+
+#define PVR_ADDON_NAME_STRING_LENGTH          1024
+#define PVR_ADDON_URL_STRING_LENGTH           1024
+#define PVR_ADDON_DESC_STRING_LENGTH          1024
+#define PVR_ADDON_TIMERTYPE_STRING_LENGTH     128
+#define PVR_ADDON_TIMERTYPE_ARRAY_SIZE        32
+#define PVR_ADDON_TIMERTYPE_VALUES_ARRAY_SIZE 512
+
+#define PVR_STREAM_PROPERTY_STREAMURL        "streamurl"
+#define PVR_STREAM_PROPERTY_ISREALTIMESTREAM "isrealtimestream"
+
+#define EPG_TAG_INVALID_UID        0
+#define EPG_TAG_FLAG_UNDEFINED     0
+#define EPG_GENRE_USE_STRING       0x100
+#define EPG_STRING_TOKEN_SEPARATOR ","
+#define EPG_TIMEFRAME_UNLIMITED    -1
+
+#define PVR_TIMER_NO_PARENT 0
+
+#define PVR_TIMER_TYPE_IS_MANUAL                  0x00000001
+#define PVR_TIMER_TYPE_IS_REPEATING               0x00000002
+#define PVR_TIMER_TYPE_IS_READONLY                0x00000004
+#define PVR_TIMER_TYPE_FORBIDS_NEW_INSTANCES      0x00000008
+#define PVR_TIMER_TYPE_SUPPORTS_ENABLE_DISABLE    0x00000010
+#define PVR_TIMER_TYPE_SUPPORTS_CHANNELS          0x00000020
+#define PVR_TIMER_TYPE_SUPPORTS_START_TIME        0x00000040
+#define PVR_TIMER_TYPE_SUPPORTS_END_TIME          0x00000100
+#define PVR_TIMER_TYPE_SUPPORTS_WEEKDAYS          0x00000800
+#define PVR_TIMER_TYPE_SUPPORTS_START_END_MARGIN  0x00002000
+#define PVR_TIMER_TYPE_REQUIRES_EPG_TAG_ON_CREATE 0x00080000
+
+#define PVR_WEEKDAY_MONDAY    0x01
+#define PVR_WEEKDAY_TUESDAY   0x02
+#define PVR_WEEKDAY_WEDNESDAY 0x04
+#define PVR_WEEKDAY_THURSDAY  0x08
+#define PVR_WEEKDAY_FRIDAY    0x10
+#define PVR_WEEKDAY_SATURDAY  0x20
+#define PVR_WEEKDAY_SUNDAY    0x40
+
+typedef void * ADDON_HANDLE;
+
+enum PVR_ERROR
+{
+  PVR_ERROR_NO_ERROR           =  0,
+  PVR_ERROR_UNKNOWN            = -1,
+  PVR_ERROR_NOT_IMPLEMENTED    = -2,
+  PVR_ERROR_SERVER_ERROR       = -3,
+  PVR_ERROR_FAILED             = -8,
+  PVR_ERROR_INVALID_PARAMETERS = -9
+};
+
+enum EPG_EVENT_STATE
+{
+  EPG_EVENT_CREATED = 0,
+  EPG_EVENT_UPDATED = 1,
+  EPG_EVENT_DELETED = 2
+};
+
+enum PVR_TIMER_STATE
+{
+  PVR_TIMER_STATE_NEW,
+  PVR_TIMER_STATE_SCHEDULED,
+  PVR_TIMER_STATE_RECORDING,
+  PVR_TIMER_STATE_COMPLETED,
+  PVR_TIMER_STATE_ABORTED,
+  PVR_TIMER_STATE_CANCELLED,
+  PVR_TIMER_STATE_CONFLICT_OK,
+  PVR_TIMER_STATE_CONFLICT_NOK,
+  PVR_TIMER_STATE_ERROR,
+  PVR_TIMER_STATE_DISABLED
+};
+
+enum PVR_RECORDING_CHANNEL_TYPE
+{
+  PVR_RECORDING_CHANNEL_TYPE_UNKNOWN,
+  PVR_RECORDING_CHANNEL_TYPE_TV,
+  PVR_RECORDING_CHANNEL_TYPE_RADIO
+};
+
+enum PVR_MENUHOOK_CAT
+{
+  PVR_MENUHOOK_UNKNOWN,
+  PVR_MENUHOOK_ALL,
+  PVR_MENUHOOK_CHANNEL,
+  PVR_MENUHOOK_TIMER,
+  PVR_MENUHOOK_EPG,
+  PVR_MENUHOOK_RECORDING,
+  PVR_MENUHOOK_DELETED_RECORDING,
+  PVR_MENUHOOK_SETTING
+};
+
+struct PVR_NAMED_VALUE
+{
+  char strName  [PVR_ADDON_NAME_STRING_LENGTH];
+  char strValue [PVR_ADDON_NAME_STRING_LENGTH];
+};
+
+struct PVR_CHANNEL
+{
+  unsigned int iUniqueId;
+  bool         bIsRadio;
+  unsigned int iChannelNumber;
+  unsigned int iSubChannelNumber;
+  char         strChannelName [PVR_ADDON_NAME_STRING_LENGTH];
+  char         strInputFormat [PVR_ADDON_NAME_STRING_LENGTH];
+  unsigned int iEncryptionSystem;
+  char         strIconPath [PVR_ADDON_URL_STRING_LENGTH];
+  bool         bIsHidden;
+};
+
+struct PVR_CHANNEL_GROUP
+{
+  char         strGroupName [PVR_ADDON_NAME_STRING_LENGTH];
+  bool         bIsRadio;
+  unsigned int iPosition;
+};
+
+struct EPG_TAG
+{
+  unsigned int iUniqueBroadcastId;
+  unsigned int iUniqueChannelId;
+  const char * strTitle;
+  time_t       startTime;
+  time_t       endTime;
+  const char * strPlotOutline;
+  const char * strPlot;
+  const char * strOriginalTitle;
+  const char * strCast;
+  const char * strDirector;
+  const char * strWriter;
+  int          iYear;
+  const char * strIMDBNumber;
+  const char * strIconPath;
+  int          iGenreType;
+  int          iGenreSubType;
+  const char * strGenreDescription;
+  time_t       firstAired;
+  int          iParentalRating;
+  int          iStarRating;
+  bool         bNotify;
+  int          iSeriesNumber;
+  int          iEpisodeNumber;
+  int          iEpisodePartNumber;
+  const char * strEpisodeName;
+  unsigned int iFlags;
+};
+
+struct PVR_TIMER
+{
+  unsigned int    iClientIndex;
+  unsigned int    iParentClientIndex;
+  int             iClientChannelUid;
+  time_t          startTime;
+  time_t          endTime;
+  bool            bStartAnyTime;
+  bool            bEndAnyTime;
+  PVR_TIMER_STATE state;
+  unsigned int    iTimerType;
+  char            strTitle [PVR_ADDON_NAME_STRING_LENGTH];
+  char            strEpgSearchString [PVR_ADDON_NAME_STRING_LENGTH];
+  bool            bFullTextEpgSearch;
+  char            strDirectory [PVR_ADDON_URL_STRING_LENGTH];
+  char            strSummary [PVR_ADDON_DESC_STRING_LENGTH];
+  int             iPriority;
+  int             iLifetime;
+  int             iMaxRecordings;
+  unsigned int    iRecordingGroup;
+  time_t          firstDay;
+  unsigned int    iWeekdays;
+  unsigned int    iPreventDuplicateEpisodes;
+  unsigned int    iEpgUid;
+  unsigned int    iMarginStart;
+  unsigned int    iMarginEnd;
+  int             iGenreType;
+  int             iGenreSubType;
+  char            strSeriesLink [PVR_ADDON_URL_STRING_LENGTH];
+};
+
+struct PVR_TIMER_TYPE_ATTRIBUTE_INT_VALUE
+{
+  int  iValue;
+  char strDescription [PVR_ADDON_TIMERTYPE_STRING_LENGTH];
+};
+
+struct PVR_TIMER_TYPE
+{
+  unsigned int iId;
+  unsigned int iAttributes;
+  char         strDescription [PVR_ADDON_TIMERTYPE_STRING_LENGTH];
+  unsigned int iPrioritiesSize;
+  PVR_TIMER_TYPE_ATTRIBUTE_INT_VALUE priorities [PVR_ADDON_TIMERTYPE_VALUES_ARRAY_SIZE];
+  int          iPrioritiesDefault;
+  unsigned int iLifetimesSize;
+  PVR_TIMER_TYPE_ATTRIBUTE_INT_VALUE lifetimes [PVR_ADDON_TIMERTYPE_VALUES_ARRAY_SIZE];
+  int          iLifetimesDefault;
+  unsigned int iPreventDuplicateEpisodesSize;
+  PVR_TIMER_TYPE_ATTRIBUTE_INT_VALUE preventDuplicateEpisodes [PVR_ADDON_TIMERTYPE_VALUES_ARRAY_SIZE];
+  unsigned int iPreventDuplicateEpisodesDefault;
+  unsigned int iRecordingGroupSize;
+  PVR_TIMER_TYPE_ATTRIBUTE_INT_VALUE recordingGroup [PVR_ADDON_TIMERTYPE_VALUES_ARRAY_SIZE];
+  unsigned int iRecordingGroupDefault;
+  unsigned int iMaxRecordingsSize;
+  PVR_TIMER_TYPE_ATTRIBUTE_INT_VALUE maxRecordings [PVR_ADDON_TIMERTYPE_VALUES_ARRAY_SIZE];
+  int          iMaxRecordingsDefault;
+};
+
+struct PVR_RECORDING
+{
+  char   strRecordingId [PVR_ADDON_NAME_STRING_LENGTH];
+  char   strTitle [PVR_ADDON_NAME_STRING_LENGTH];
+  char   strEpisodeName [PVR_ADDON_NAME_STRING_LENGTH];
+  int    iSeriesNumber;
+  int    iEpisodeNumber;
+  int    iYear;
+  char   strDirectory [PVR_ADDON_URL_STRING_LENGTH];
+  char   strPlotOutline [PVR_ADDON_DESC_STRING_LENGTH];
+  char   strPlot [PVR_ADDON_DESC_STRING_LENGTH];
+  char   strGenreDescription [PVR_ADDON_DESC_STRING_LENGTH];
+  char   strChannelName [PVR_ADDON_NAME_STRING_LENGTH];
+  char   strIconPath [PVR_ADDON_URL_STRING_LENGTH];
+  char   strThumbnailPath [PVR_ADDON_URL_STRING_LENGTH];
+  char   strFanartPath [PVR_ADDON_URL_STRING_LENGTH];
+  time_t recordingTime;
+  int    iDuration;
+  int    iPriority;
+  int    iLifetime;
+  int    iGenreType;
+  int    iGenreSubType;
+  int    iPlayCount;
+  int    iLastPlayedPosition;
+  bool   bIsDeleted;
+  unsigned int iEpgEventId;
+  int    iChannelUid;
+  PVR_RECORDING_CHANNEL_TYPE channelType;
+};
+
+struct PVR_MENUHOOK
+{
+  unsigned int     iHookId;
+  unsigned int     iLocalizedStringId;
+  PVR_MENUHOOK_CAT category;
+};
+
+struct PVR_MENUHOOK_DATA
+{
+  PVR_MENUHOOK_CAT cat;
+  union
+  {
+    unsigned int  iEpgUid;
+    PVR_CHANNEL   channel;
+    PVR_TIMER     timer;
+    PVR_RECORDING recording;
+  } data;
+};
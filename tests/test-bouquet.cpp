@@ -0,0 +1,176 @@
+/*
+ *      Copyright (C) 2018 Aassif Benassarou
+ *      http://github.com/aassif/pvr.freebox/
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <tuple>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include "Bouquet.h"
+
+using namespace std;
+
+// Bouquet::Resolve () versus the former map-based resolver, on synthetic
+// bouquets (same winners, same order), with timings.
+
+class Conflict
+{
+  public:
+    string uuid;
+    int major, minor;
+    int position;
+};
+
+// The former resolver (ProcessChannels), winners by number.
+static vector<Conflict> legacy_resolve (const vector<Conflict> & bouquet)
+{
+  auto comparator = [] (const Conflict & c1, const Conflict & c2) {return tie (c1.major, c1.minor) < tie (c2.major, c2.minor);};
+
+  map<string, vector<Conflict>> conflicts_by_uuid;
+  map<int,    vector<Conflict>> conflicts_by_major;
+  for (const Conflict & c : bouquet)
+  {
+    conflicts_by_uuid [c.uuid] .push_back (c);
+    conflicts_by_major[c.major].push_back (c);
+  }
+
+  for (auto & [major, v1] : conflicts_by_major)
+  {
+    sort (v1.begin (), v1.end (), comparator);
+    for (size_t j = 1; j < v1.size (); ++j)
+    {
+      vector<Conflict> & v2 = conflicts_by_uuid [v1[j].uuid];
+      v2.erase (remove_if (v2.begin (), v2.end (), [m = major] (const Conflict & c) {return c.major == m;}), v2.end ());
+    }
+    v1.erase (v1.begin () + 1, v1.end ());
+  }
+
+  for (auto & [uuid, v1] : conflicts_by_uuid)
+    if (! v1.empty ())
+    {
+      sort (v1.begin (), v1.end (), comparator);
+      for (size_t j = 1; j < v1.size (); ++j)
+      {
+        vector<Conflict> & v2 = conflicts_by_major [v1[j].major];
+        v2.erase (remove_if (v2.begin (), v2.end (), [u = uuid] (const Conflict & c) {return c.uuid == u;}), v2.end ());
+      }
+      v1.erase (v1.begin () + 1, v1.end ());
+    }
+
+  vector<Conflict> winners;
+  for (auto & [major, q] : conflicts_by_major)
+    if (! q.empty ())
+      winners.push_back (q[0]);
+
+  return winners;
+}
+
+// Channels have several numbers, numbers have several channels (sub-numbers
+// are unique, and so is a channel within a number: the former resolver lost both).
+static vector<Conflict> test_bouquet (int n, mt19937 & random)
+{
+  int channels = max (1, n * 2 / 3);
+  int majors   = max (1, n / 2);
+
+  vector<Conflict> bouquet;
+  set<pair<int, int>> numbers;
+  set<pair<unsigned int, int>> pairs;
+  while ((int) bouquet.size () < n)
+  {
+    int major = 1 + random () % majors;
+    int minor = random () % 8;
+    unsigned int channel = random () % channels;
+    if (numbers.count (make_pair (major, minor)) || ! pairs.insert (make_pair (channel, major)).second) continue;
+    numbers.insert (make_pair (major, minor));
+    string uuid = "uuid-webtv-" + to_string (channel);
+    bouquet.push_back (Conflict {uuid, major, minor, (int) bouquet.size ()});
+  }
+
+  return bouquet;
+}
+
+template <typename F>
+double test_ms (const F & f)
+{
+  auto start = chrono::steady_clock::now ();
+  f ();
+  return chrono::duration<double, milli> (chrono::steady_clock::now () - start).count ();
+}
+
+int main ()
+{
+  // A channel twice under one number keeps its lowest sub-number.
+  {
+    Bouquet b;
+    b.Add ("a", 1, 1, 0);
+    b.Add ("a", 1, 0, 1);
+    b.Add ("b", 1, 2, 2);
+    b.Add ("b", 2, 0, 3);
+    vector<Bouquet::Entry> w = b.Resolve ();
+    if (w.size () != 2 || w[0].uuid != "a" || w[0].minor != 0 || w[1].uuid != "b" || w[1].major != 2) return 1;
+  }
+
+  mt19937 random (42);
+
+  for (int n : {10, 100, 1000, 5000, 10000, 20000})
+  {
+    vector<Conflict> bouquet = test_bouquet (n, random);
+
+    vector<Conflict> expected;
+    double ms1 = test_ms ([&] {expected = legacy_resolve (bouquet);});
+
+    vector<Bouquet::Entry> winners;
+    double ms2 = test_ms ([&]
+    {
+      Bouquet b (bouquet.size ());
+      for (const Conflict & c : bouquet)
+        b.Add (c.uuid, c.major, c.minor, c.position);
+      winners = b.Resolve ();
+    });
+
+    cout << n << " entries, " << winners.size () << " channels: "
+         << "maps " << ms1 << " ms, Bouquet " << ms2 << " ms" << endl;
+
+    if (winners.size () != expected.size ())
+    {
+      cerr << n << ": " << winners.size () << " winners, expected " << expected.size () << endl;
+      return 1;
+    }
+
+    for (size_t i = 0; i < winners.size (); ++i)
+    {
+      const Bouquet::Entry & w = winners[i];
+      const Conflict       & e = expected[i];
+      if (w.uuid != e.uuid || w.major != e.major || w.minor != e.minor || w.position != e.position)
+      {
+        cerr << n << ": #" << i << " is " << w.uuid << " (" << w.major << '.' << w.minor << "), expected "
+             << e.uuid << " (" << e.major << '.' << e.minor << ')' << endl;
+        return 1;
+      }
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,245 @@
+/*
+ *      Copyright (C) 2018 Aassif Benassarou
+ *      http://github.com/aassif/pvr.freebox/
+ *
+ *  This Program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2, or (at your option)
+ *  any later version.
+ *
+ *  This Program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with XBMC; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.
+ *  http://www.gnu.org/copyleft/gpl.html
+ *
+ */
+
+#include <iostream>
+#include <sstream>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include "client.h"
+#include "Freebox.h"
+#include "p8-platform/util/timeutils.h"
+
+using namespace std;
+
+// Zapping while the backend is busy: the Freebox Server is stubbed, and only
+// the channels and the login are served right away. Every other query (EPG,
+// timers, recordings) takes a while, and the real GetChannelStreamProperties,
+// GetChannels and GetTimers must not wait for it, i.e. m_mutex is never held
+// across network I/O.
+
+#define TEST_CHANNELS      200
+#define TEST_BACKEND_DELAY 500  // ms (one slow query)
+#define TEST_DURATION      2000 // ms
+#define TEST_MAX_LATENCY   50   // ms (one call)
+
+class Test : public Freebox
+{
+  private:
+    string             m_channels;
+    string             m_bouquet;
+    P8PLATFORM::CEvent m_release;
+    atomic<int>        m_in_flight;
+
+  public:
+    Test (const string & path);
+    ~Test ();
+
+    // Slow queries in progress.
+    int InFlight () const {return m_in_flight;}
+
+    static int Run ();
+
+  protected:
+    int HTTP (const string & custom,
+              const string & path,
+              const rapidjson::Document &,
+              const Parser &) override;
+
+    string Reply (const string & path, bool * slow) const;
+};
+
+Test::Test (const string & path) :
+  //       path, source, quality, days, extended, window, budget, colors, delay, connections, keepalive, workers
+  Freebox (path, 0,      0,       1,    false,    6,      32,     false,  10,    1,           1,         2),
+  m_channels (),
+  m_bouquet (),
+  m_release (false),
+  m_in_flight (0)
+{
+  ostringstream channels, bouquet;
+  for (int i = 1; i <= TEST_CHANNELS; ++i)
+  {
+    string uuid = "uuid-webtv-" + to_string (i);
+    channels << (i > 1 ? "," : "")
+             << '"' << uuid << "\":{\"name\":\"Channel " << i << "\",\"logo_url\":\"/logo/" << i << ".png\"}";
+    bouquet  << (i > 1 ? "," : "")
+             << "{\"uuid\":\"" << uuid << "\",\"number\":" << i << ",\"sub_number\":0,\"available\":true,\"streams\":["
+             << "{\"type\":\"iptv\",\"quality\":\"hd\",\"rtsp\":\"rtsp://iptv/" << i << "\"},"
+             << "{\"type\":\"dvb\",\"quality\":\"sd\",\"rtsp\":\"rtsp://dvb/" << i << "\"}]}";
+  }
+
+  m_channels = "{\"success\":true,\"result\":{" + channels.str () + "}}";
+  m_bouquet  = "{\"success\":true,\"result\":[" + bouquet.str  () + "]}";
+}
+
+Test::~Test ()
+{
+  // Slow queries return at once from now on.
+  m_release.Broadcast ();
+  Stop ();
+}
+
+string Test::Reply (const string & path, bool * slow) const
+{
+  *slow = false;
+
+  if (path == "/api/v6/tv/channels")
+    return m_channels;
+
+  if (path == "/api/v6/tv/bouquets/freeboxtv/channels")
+    return m_bouquet;
+
+  if (path == "/api/v6/login/authorize")
+    return "{\"success\":true,\"result\":{\"app_token\":\"token\",\"track_id\":1}}";
+
+  if (path.compare (0, 24, "/api/v6/login/authorize/") == 0)
+    return "{\"success\":true,\"result\":{\"status\":\"granted\",\"challenge\":\"challenge\"}}";
+
+  if (path.compare (0, 21, "/api/v6/login/session") == 0)
+    return "{\"success\":true,\"result\":{\"session_token\":\"session\"}}";
+
+  if (path.compare (0, 14, "/api/v6/login/") == 0)
+    return "{\"success\":true}";
+
+  *slow = true;
+
+  if (path.compare (0, 15, "/api/v6/tv/epg/") == 0)
+    return "{\"success\":true,\"result\":{}}";
+
+  return "{\"success\":true,\"result\":[]}";
+}
+
+int Test::HTTP (const string &,
+                const string & path,
+                const rapidjson::Document &,
+                const Parser & parse)
+{
+  bool   slow  = false;
+  string reply = Reply (path, &slow);
+
+  if (slow)
+  {
+    ++m_in_flight;
+    m_release.Wait (TEST_BACKEND_DELAY);
+    --m_in_flight;
+  }
+
+  size_t offset = 0;
+  HTTPStream is ([&reply, &offset] (char * buffer, size_t size) -> ssize_t
+  {
+    size_t n = min (size, reply.size () - offset);
+    memcpy (buffer, reply.data () + offset, n);
+    offset += n;
+    return n;
+  });
+
+  parse (is);
+  return 200;
+}
+
+int Test::Run ()
+{
+  string path = (filesystem::temp_directory_path () / "pvr.freebox-test-latency").string () + '/';
+  filesystem::remove_all (path);
+  filesystem::create_directories (path);
+
+  Test t (path);
+  t.Start ();
+
+  // Once the backend is busy...
+  int64_t timeout = P8PLATFORM::GetTimeMs () + 10000;
+  while (t.InFlight () == 0)
+  {
+    if (P8PLATFORM::GetTimeMs () > timeout)
+    {
+      cerr << "no query in flight" << endl;
+      return 1;
+    }
+    this_thread::sleep_for (chrono::milliseconds (1));
+  }
+
+  // ... zap, and list channels and timers now and then.
+  int64_t worst = 0;
+  int     calls = 0;
+  int     busy  = 0; // while queries were in flight
+  auto timed = [&] (const function<PVR_ERROR ()> & f)
+  {
+    bool      b       = t.InFlight () > 0;
+    int64_t   start   = P8PLATFORM::GetTimeMs ();
+    PVR_ERROR e       = f ();
+    int64_t   latency = P8PLATFORM::GetTimeMs () - start;
+    worst = max (worst, latency);
+    busy += b;
+    ++calls;
+    return e == PVR_ERROR_NO_ERROR;
+  };
+
+  int64_t end = P8PLATFORM::GetTimeMs () + TEST_DURATION;
+  for (unsigned int i = 1; P8PLATFORM::GetTimeMs () < end; i = i % TEST_CHANNELS + 1)
+  {
+    PVR_CHANNEL channel;
+    memset (&channel, 0, sizeof (PVR_CHANNEL));
+    channel.iUniqueId = i;
+
+    PVR_NAMED_VALUE properties [2];
+    unsigned int count = 2;
+    if (! timed ([&] {return t.GetChannelStreamProperties (&channel, properties, &count);})
+     || count != 2 || strncmp (properties[0].strValue, "rtsp://", 7) != 0)
+    {
+      cerr << "channel " << i << ": no stream" << endl;
+      return 1;
+    }
+
+    if (i == TEST_CHANNELS)
+    {
+      unsigned int channels = PVR->channels;
+      if (! timed ([&] {return t.GetChannels (nullptr, false);})
+       || PVR->channels - channels != TEST_CHANNELS)
+      {
+        cerr << "GetChannels: " << PVR->channels - channels << " channels" << endl;
+        return 1;
+      }
+
+      if (! timed ([&] {return t.GetTimers (nullptr);}))
+      {
+        cerr << "GetTimers failed" << endl;
+        return 1;
+      }
+    }
+  }
+
+  cout << calls << " calls (" << busy << " with queries in flight), worst " << worst << " ms" << endl;
+  if (busy == 0 || worst > TEST_MAX_LATENCY)
+  {
+    cerr << "calls stalled behind the backend" << endl;
+    return 1;
+  }
+
+  return 0;
+}
+
+int main ()
+{
+  return Test::Run ();
+}